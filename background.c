@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+#include "background.h"
+#include "probe.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Not exported by libc so taken from the kernel
+// where the idle class only gets disk time when
+// nothing else wants it
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+// Lowest scheduling priority for a process
+static const int BACKGROUND_NICENESS = 19;
+
+// Entries treated per second where each entry
+// costs a handful of calls to the filesystem
+static const long BACKGROUND_RATE = 1000;
+
+// Probes run at once, allowing a single
+// replacement for a probe stuck for good
+static const int BACKGROUND_PROBES = 1;
+static const int BACKGROUND_MAX_PROBES = 2;
+
+static int gbackground = 0;
+static struct timespec gstarted;
+static long gpaced = 0;
+
+/**
+ * Lower disk and processor priorities for the whole process
+ * before any probe workers start so they inherit them, where
+ * each is a best effort since neither changes what's listed
+ */
+void enter_background(void) {
+  gbackground = 1;
+  int ioprio = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) == -1) {
+    perror("Issue lowering disk priority");
+  }
+  if (setpriority(PRIO_PROCESS, 0, BACKGROUND_NICENESS) == -1) {
+    perror("Issue lowering processor priority");
+  }
+  limit_probes(BACKGROUND_PROBES, BACKGROUND_MAX_PROBES);
+  clock_gettime(CLOCK_MONOTONIC, &gstarted);
+}
+
+/**
+ * Check whether we're running in the background
+ */
+int is_background(void) { return gbackground; }
+
+/**
+ * Account for treating another entry and sleep whenever
+ * we're ahead of the rate allowed in the background
+ */
+void pace_background(void) {
+  if (!gbackground) {
+    return;
+  }
+  gpaced++;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long elapsed = (now.tv_sec - gstarted.tv_sec) * 1000000000LL +
+                      (now.tv_nsec - gstarted.tv_nsec);
+  long long allowed = gpaced * 1000000000LL / BACKGROUND_RATE;
+  if (allowed > elapsed) {
+    long long ahead = allowed - elapsed;
+    struct timespec pause = {ahead / 1000000000LL, ahead % 1000000000LL};
+    nanosleep(&pause, NULL);
+  }
+}
+
+/**
+ * Open a directory for reading where background runs avoid
+ * updating access times, which would otherwise dirty every
+ * inode read and queue writes competing with the host
+ */
+DIR *open_directory(const char *path) {
+  if (!gbackground) {
+    return opendir(path);
+  }
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  int fd = open(path, flags | O_NOATIME);
+  // Only owners may skip access times
+  if (fd == -1 && errno == EPERM) {
+    fd = open(path, flags);
+  }
+  if (fd == -1) {
+    return NULL;
+  }
+  DIR *dir = fdopendir(fd);
+  if (dir == NULL) {
+    close(fd);
+  }
+  return dir;
+}
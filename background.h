@@ -0,0 +1,15 @@
+#include <dirent.h>
+#include <stddef.h>
+
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+void enter_background(void);
+
+int is_background(void);
+
+void pace_background(void);
+
+DIR *open_directory(const char *path);
+
+#endif
@@ -1,9 +1,18 @@
+#define _GNU_SOURCE
 #include "command.h"
+#include "background.h"
+#include "escalate.h"
+#include "git.h"
+#include "journal.h"
+#include "layer.h"
 #include "options/hidden.h"
 #include "options/link.h"
 #include "options/list.h"
 #include "options/none.h"
+#include "options/sync.h"
 #include "options/unlink.h"
+#include "probe.h"
+#include <dirent.h>
 #include <errno.h>
 #include <fnmatch.h>
 #include <ftw.h>
@@ -30,16 +39,62 @@
 #define ANSI_COLOR_RESET "\x1b[0m"
 
 #define GREEN(str) ANSI_COLOR_GREEN str ANSI_COLOR_RESET
+#define YELLOW(str) ANSI_COLOR_YELLOW str ANSI_COLOR_RESET
 
 // Setting some options globally for now so we can
 // access them in places we can't easily get to like
 // inside functions passed as pointers to ftw
 static list_opts_t glist_opts = {0};
+static link_opts_t glink_opts = {0};
+
+// Resolved once per run since every entry is
+// mapped using the same project and root prefix
+static char gprefix[PATH_MAX + 1];
+static char groot[PATH_MAX + 1];
+static int gprefixes_resolved = 0;
+static int groot_exists = 0;
+
+// Deadline in milliseconds for link probes when listing
+// along with directories where probes have timed out
+static int gprobe_timeout = 0;
+typedef struct {
+  char *dpath;
+  int count;
+} slow_directory_t;
+static slow_directory_t *gslow_directories = NULL;
+static int gslow_count = 0;
+
+// Links created this run and those short enough for
+// the filesystem to keep their target inside the inode
+// rather than a separate block, where 60 is the ext4 size
+static const size_t INLINE_LINK_SIZE = 60;
+static int glinks_made = 0;
+static int ginline_links = 0;
+
+// Paths changed between revisions when syncing, all
+// collected before touching anything so every decision
+// sees links as they were before the sync started
+typedef struct {
+  char *rpath;
+  change_t change;
+  unsigned char sha[GIT_SHA_LENGTH];
+  int isdir;
+  int linked;
+} sync_change_t;
+static sync_change_t *gsync_changes = NULL;
+static int gsync_count = 0;
 
 static const char *ROOT_DIRECTORY = "/";
 static const char *CURRENT_DIRECTORY = ".";
+static const char *GIT_DIRECTORY = ".git";
+static const char *HEAD_REVISION = "HEAD";
 static const char *VERSION = "0.0.1";
 
+// Bounds for estimating the size of either side
+// when choosing how to look up links automatically
+static const int ESTIMATE_DEPTH = 3;
+static const size_t ESTIMATE_CAP = 4096;
+
 /**
  * Map a command to a better suited enum
  */
@@ -47,7 +102,13 @@ command_t map_command(char *command) {
   const struct {
     command_t val;
     const char *str;
-  } map[] = {{NONE, ""}, {LINK, "link"}, {LIST, "list"}, {UNLINK, "unlink"}};
+  } map[] = {
+      {NONE, ""},
+      {LINK, "link"},
+      {LIST, "list"},
+      {SYNC, "sync"},
+      {UNLINK, "unlink"}
+  };
   size_t length = sizeof(map) / sizeof(map[0]);
   for (size_t i = 0; i < length; i++) {
     if (!strcmp(command, map[i].str)) {
@@ -57,6 +118,26 @@ command_t map_command(char *command) {
   return NONE;
 }
 
+/**
+ * Map a list side value to a better suited enum
+ */
+side_t map_side(char *side) {
+  const struct {
+    side_t val;
+    const char *str;
+  } map[] = {
+      {AUTO_SIDE, "auto"}, {PROJECT_SIDE, "project"}, {ROOT_SIDE, "root"}
+  };
+  size_t length = sizeof(map) / sizeof(map[0]);
+  for (size_t i = 0; i < length; i++) {
+    if (!strcmp(side, map[i].str)) {
+      return map[i].val;
+    }
+  }
+  fprintf(stderr, "Invalid side `%s'\n", side);
+  exit(EXIT_FAILURE);
+}
+
 /**
  * Print help information on how to use
  * command-line flags and accepted arguments
@@ -73,11 +154,13 @@ void print_none_usage(char **argv) {
   printf("Commands:\n");
   printf("  link                 Link local files or directories\n");
   printf("  list                 List all of the tracked dotfiles\n");
+  printf("  sync                 Sync links with changes since a revision\n");
   printf("  unlink               Unlink local files or directories\n\n");
   printf("Options:\n");
   printf("  -h, --help           Print this help and exit\n");
   printf("  -v, --version        Print the current version number\n");
-  printf("  -r, --root           Specify a path for another link location\n\n");
+  printf("  -r, --root           Specify a path for another link location\n");
+  printf("  -L, --layer          Overlay another project taking precedence\n\n");
 }
 
 /**
@@ -85,7 +168,7 @@ void print_none_usage(char **argv) {
  * command-line flags and accepted arguments
  */
 void print_link_usage(char **argv) {
-  printf("Usage: %s link <path> [options]\n\n", argv[0]);
+  printf("Usage: %s link <path...> [options]\n\n", argv[0]);
   printf("Link local files or directories\n\n");
   printf(
       "Linked files and folders are mapped to their system location based\n"
@@ -93,8 +176,11 @@ void print_link_usage(char **argv) {
       "project mapping to the root of the system.\n\n"
   );
   printf("Options:\n");
+  printf("  -c, --relative       Link using the shortest relative path\n");
   printf("  -h, --force          Link even if a link exists\n");
-  printf("  -h, --help           Print this help and exit\n\n");
+  printf("  -h, --help           Print this help and exit\n");
+  printf("  -p, --parents        Create missing parent directories\n");
+  printf("  -R, --resume         Continue from the last checkpoint\n\n");
 }
 
 /**
@@ -110,7 +196,28 @@ void print_unlink_usage(char **argv) {
       "the project mapping to the root of the system.\n\n"
   );
   printf("Options:\n");
-  printf("  -h, --help           Print this help and exit\n\n");
+  printf("  -h, --help           Print this help and exit\n");
+  printf("  -R, --resume         Continue from the last checkpoint\n\n");
+}
+
+/**
+ * Print help information for sync command
+ * command-line flags and accepted arguments
+ */
+void print_sync_usage(char **argv) {
+  printf("Usage: %s sync --since <rev> [options]\n\n", argv[0]);
+  printf("Sync links with changes since a revision\n\n");
+  printf(
+      "Paths added, removed, or renamed between the given revision and\n"
+      "the current commit are read from the repository and relinked or\n"
+      "unlinked without walking the project. Added paths are only\n"
+      "linked when renamed from a linked path unless adopting them\n"
+      "next to linked siblings.\n\n"
+  );
+  printf("Options:\n");
+  printf("  -a, --adopt          Link added paths next to linked siblings\n");
+  printf("  -h, --help           Print this help and exit\n");
+  printf("  -s, --since          Revision to sync changes from\n\n");
 }
 
 /**
@@ -118,27 +225,28 @@ void print_unlink_usage(char **argv) {
  * command-line flags and accepted arguments
  */
 void print_list_usage(char **argv) {
-  printf("Usage: %s list [options]\n\n", argv[0]);
+  printf("Usage: %s list [path...] [options]\n\n", argv[0]);
   printf("List all of the tracked dotfiles\n\n");
   printf(
       "All files discovered from the project root are listed using\n"
-      "their system location with links highlighted in green.\n\n"
+      "their system location with links highlighted in green. Given\n"
+      "paths only the project beneath them is listed instead.\n\n"
   );
   printf("Options:\n");
+  printf("  -b, --background     Yield disk and processor to the host\n");
+  printf("  -e, --exclude        Skip paths matching a glob and beneath\n");
   printf("  -h, --help           Print this help and exit\n");
+  printf("  -i, --include        Only list paths matching a glob or beneath\n");
   printf("  -l, --linked         Filter for files actually linked\n");
-  printf("  -o, --owner          List the owner with the linked file\n\n");
+  printf("  -o, --owner          List the owner with the linked file\n");
+  printf("  -s, --side           Look up links from auto, project, or root\n");
+  printf("  -t, --timeout        Milliseconds before a link is unknown\n\n");
 }
 
 /**
- * Read file stats for a file or an expected link which
- * often won't exist but we want to handle nicely
+ * Exit for any file mode we don't handle
  */
-int get_file_stats(const char *filename, struct stat *sb) {
-  if (stat(filename, sb) == -1) {
-    // Assuming no such file or directory
-    return 1;
-  }
+void check_file_mode(const struct stat *sb) {
   // We only want to handle certain files
   // directory, symlink, regular file
   int mode = sb->st_mode & S_IFMT;
@@ -152,9 +260,112 @@ int get_file_stats(const char *filename, struct stat *sb) {
       fprintf(stderr, "Unsupported file mode `%d'\n", mode);
       exit(EXIT_FAILURE);
   }
+}
+
+/**
+ * Read file stats for a file or an expected link which
+ * often won't exist but we want to handle nicely
+ */
+int get_file_stats(const char *filename, struct stat *sb) {
+  if (stat(filename, sb) == -1) {
+    // Assuming no such file or directory
+    return 1;
+  }
+  check_file_mode(sb);
   return 0;
 }
 
+/**
+ * Find the slow directory a link path sits beneath if
+ * any, where all probes are expected to time out
+ */
+slow_directory_t *find_slow_directory(const char *lpath) {
+  for (int i = 0; i < gslow_count; i++) {
+    char *dpath = gslow_directories[i].dpath;
+    size_t length = strlen(dpath);
+    if (!strncmp(lpath, dpath, length) &&
+        (lpath[length] == '/' || !strcmp(dpath, ROOT_DIRECTORY))) {
+      return &gslow_directories[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Remember the parent directory of a link path whose
+ * probe timed out so we don't wait on its siblings
+ */
+void add_slow_directory(const char *lpath) {
+  size_t size = (gslow_count + 1) * sizeof(slow_directory_t);
+  gslow_directories = (slow_directory_t *)realloc(gslow_directories, size);
+  if (gslow_directories == NULL) {
+    fprintf(stderr, "Failure allocating slow directories\n");
+    exit(EXIT_FAILURE);
+  }
+  char *dpath = strdup(lpath);
+  char *slash = strrchr(dpath, '/');
+  if (slash == dpath) {
+    strcpy(dpath, ROOT_DIRECTORY);
+  } else if (slash) {
+    *slash = '\0';
+  }
+  gslow_directories[gslow_count++] = (slow_directory_t){dpath, 1};
+}
+
+/**
+ * Read file stats for an expected link, bounded by the probe
+ * timeout when given since the root might sit on a hung or slow
+ * filesystem. Returns -1 when the stats are unknown.
+ */
+int get_link_stats(const char *lpath, struct stat *sb) {
+  if (!gprobe_timeout) {
+    return get_file_stats(lpath, sb);
+  }
+  slow_directory_t *slow = find_slow_directory(lpath);
+  if (slow) {
+    slow->count++;
+    return -1;
+  }
+  switch (probe_stat(lpath, sb, gprobe_timeout)) {
+    case PROBE_FOUND:
+      check_file_mode(sb);
+      return 0;
+    case PROBE_MISSING:
+      return 1;
+    default:
+      add_slow_directory(lpath);
+      return -1;
+  }
+}
+
+/**
+ * Summarize directories where probes timed out
+ */
+void print_slow_directories(void) {
+  for (int i = 0; i < gslow_count; i++) {
+    slow_directory_t *slow = &gslow_directories[i];
+    fprintf(
+        stderr, "Slow directory `%s' with %d unknown\n", slow->dpath,
+        slow->count
+    );
+  }
+}
+
+/**
+ * Resolve the project and root prefixes the first time they're
+ * needed rather than for every entry mapped during a walk
+ */
+void resolve_prefixes(void) {
+  if (gprefixes_resolved) {
+    return;
+  }
+  // We're only supporting calling from the
+  // project root directory for now
+  realpath(CURRENT_DIRECTORY, gprefix);
+  groot_exists = realpath(ghidden_opts.rvalue, groot) != NULL;
+  gprefixes_resolved = 1;
+}
+
 /**
  * Make the system path for some local path where a first version
  * doesn't do special mapping. Allocates memory for the returned
@@ -162,20 +373,22 @@ int get_file_stats(const char *filename, struct stat *sb) {
  * handles a custom root defined in the hidden options.
  */
 char *make_link_path(const char *fpath) {
-  // We're only supporting calling from the
-  // project root directory for now
-  char prefix[PATH_MAX + 1];
-  realpath(CURRENT_DIRECTORY, prefix);
+  resolve_prefixes();
   char fabspath[PATH_MAX + 1];
   realpath(fpath, fabspath);
-  char *pos = strstr(fabspath, prefix);
-  // Substring doesn't match
-  if (pos == NULL) {
+  // Any layer could contain the file where
+  // the base layer is the current directory
+  const char *prefix = gprefix;
+  if (get_layer_count() > 1) {
+    prefix = find_layer_prefix(fabspath);
+  } else if (strncmp(fabspath, gprefix, strlen(gprefix))) {
+    prefix = NULL;
+  }
+  if (prefix == NULL) {
     fprintf(stderr, "File outside project `%s'\n", fpath);
     exit(EXIT_FAILURE);
   }
-  char next_prefix[PATH_MAX + 1];
-  realpath(ghidden_opts.rvalue, next_prefix);
+  const char *next_prefix = groot;
   char *suffix = &fabspath[strlen(prefix) + 1];
   // Adding 1 makes enough room to add "/" if needed
   int lpathlen = strlen(next_prefix) + 1 + strlen(suffix);
@@ -213,8 +426,8 @@ int is_directory_allowed(const char *fpath) {
   int EMPTY_FLAGS = 0;
   // Hardcoding hidden git and current directory but
   // should move to persisted file input later
-  int ignore_patterns_length = 2;
-  char *ignore_patterns[] = {"./.git*", "."};
+  int ignore_patterns_length = 3;
+  char *ignore_patterns[] = {"./.git*", "./.stuff-journal", "."};
   for (int i = 0; i < ignore_patterns_length; i++) {
     char *pattern = ignore_patterns[i];
     if (fnmatch(pattern, fpath, EMPTY_FLAGS) == 0) {
@@ -226,39 +439,563 @@ int is_directory_allowed(const char *fpath) {
   return 1;
 }
 
+/**
+ * Give a project path relative to the project root
+ * without the leading current directory for matching
+ */
+const char *get_relative_path(const char *fpath) {
+  if (!strcmp(fpath, CURRENT_DIRECTORY)) {
+    return "";
+  }
+  return strncmp(fpath, "./", 2) ? fpath : &fpath[2];
+}
+
+/**
+ * Check whether any glob in a list matches a relative
+ * project path or any of its parent directories
+ */
+int matches_any(char **patterns, int count, const char *rpath) {
+  for (int i = 0; i < count; i++) {
+    const char *pattern = get_relative_path(patterns[i]);
+    if (fnmatch(pattern, rpath, FNM_LEADING_DIR) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Checks whether an entry is selected by the list include
+ * and exclude globs, matched relative to the project root
+ */
+int is_entry_selected(const char *fpath) {
+  const char *rpath = get_relative_path(fpath);
+  if (matches_any(glist_opts.evalues, glist_opts.ecount, rpath)) {
+    return 0;
+  }
+  if (!glist_opts.icount) {
+    return 1;
+  }
+  return matches_any(glist_opts.ivalues, glist_opts.icount, rpath);
+}
+
+/**
+ * Checks whether an entry or anything beneath it could be
+ * selected, which for includes means the literal part of a glob
+ * before any special characters doesn't diverge from the path
+ */
+int may_select(const char *fpath) {
+  const char *rpath = get_relative_path(fpath);
+  if (matches_any(glist_opts.evalues, glist_opts.ecount, rpath)) {
+    return 0;
+  }
+  if (!glist_opts.icount) {
+    return 1;
+  }
+  size_t rlength = strlen(rpath);
+  for (int i = 0; i < glist_opts.icount; i++) {
+    const char *pattern = get_relative_path(glist_opts.ivalues[i]);
+    size_t literal = strcspn(pattern, "*?[\\");
+    size_t length = rlength < literal ? rlength : literal;
+    if (!strncmp(rpath, pattern, length)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Make a path given on the command-line relative to the current
+ * directory like paths found while walking the project. Allocates
+ * memory for the returned pointer which needs to be freed by the
+ * caller.
+ */
+char *make_project_path(const char *path) {
+  resolve_prefixes();
+  char abspath[PATH_MAX + 1];
+  if (realpath(path, abspath) == NULL) {
+    fprintf(stderr, "Non-existent file `%s'\n", path);
+    exit(EXIT_FAILURE);
+  }
+  size_t prefixlen = strlen(gprefix);
+  char *suffix = &abspath[prefixlen];
+  if (strncmp(abspath, gprefix, prefixlen) ||
+      (*suffix != '/' && *suffix != '\0')) {
+    fprintf(stderr, "File outside project `%s'\n", path);
+    exit(EXIT_FAILURE);
+  }
+  // Suffix is either empty or starts with "/"
+  int fpathlen = strlen(CURRENT_DIRECTORY) + strlen(suffix);
+  char *fpath = (char *)malloc((fpathlen + 1) * sizeof(char));
+  strcpy(fpath, CURRENT_DIRECTORY);
+  return strcat(fpath, suffix);
+}
+
+/**
+ * Print a linked entry given its link path
+ * respecting the global list owner option
+ */
+void print_linked_entry(char *lpath) {
+  if (glist_opts.oflag) {
+    char *owner = get_link_owner(lpath);
+    printf(GREEN("%s %s\n"), owner, lpath);
+    free(owner);
+  } else {
+    printf(GREEN("%s") "\n", lpath);
+  }
+}
+
+/**
+ * Join a directory and a name into a buffer of PATH_MAX + 1
+ * without doubling the separator when given the root directory
+ */
+void join_path(char *buf, const char *dir, const char *name) {
+  const char *sep = strcmp(dir, ROOT_DIRECTORY) ? ROOT_DIRECTORY : "";
+  snprintf(buf, PATH_MAX + 1, "%s%s%s", dir, sep, name);
+}
+
+/**
+ * Check whether a directory entry should be skipped
+ * which is the case for current and parent entries
+ */
+int is_dot_entry(const char *name) {
+  return !strcmp(name, ".") || !strcmp(name, "..");
+}
+
+/**
+ * Read the type of a directory entry falling back to an
+ * lstat for filesystems which don't fill in the d_type
+ */
+unsigned char get_entry_type(struct dirent *dent, const char *path) {
+  if (dent->d_type != DT_UNKNOWN) {
+    return dent->d_type;
+  }
+  struct stat sb;
+  if (lstat(path, &sb) == -1) {
+    return DT_UNKNOWN;
+  }
+  if (S_ISLNK(sb.st_mode)) {
+    return DT_LNK;
+  }
+  if (S_ISDIR(sb.st_mode)) {
+    return DT_DIR;
+  }
+  return S_ISREG(sb.st_mode) ? DT_REG : DT_UNKNOWN;
+}
+
+/**
+ * Count entries of a project directory and its mapped root
+ * directory in lockstep down to a fixed depth, giving cheap
+ * estimates for the cost of walking either of the two sides
+ */
+void estimate_sides(
+    const char *fpath, const char *lpath, int depth, size_t *fcount,
+    size_t *lcount
+) {
+  if (depth > ESTIMATE_DEPTH || *fcount >= ESTIMATE_CAP) {
+    return;
+  }
+  struct dirent *dent;
+  // Root side entries only matter where
+  // they overlap with the project
+  DIR *ldir = open_directory(lpath);
+  if (ldir != NULL) {
+    while (*lcount < ESTIMATE_CAP && (dent = readdir(ldir)) != NULL) {
+      if (!is_dot_entry(dent->d_name)) {
+        (*lcount)++;
+      }
+    }
+    closedir(ldir);
+  }
+  DIR *fdir = open_directory(fpath);
+  if (fdir == NULL) {
+    return;
+  }
+  while (*fcount < ESTIMATE_CAP && (dent = readdir(fdir)) != NULL) {
+    pace_background();
+    char nfpath[PATH_MAX + 1];
+    join_path(nfpath, fpath, dent->d_name);
+    if (is_dot_entry(dent->d_name) || !is_directory_allowed(nfpath)) {
+      continue;
+    }
+    (*fcount)++;
+    if (get_entry_type(dent, nfpath) == DT_DIR) {
+      char nlpath[PATH_MAX + 1];
+      join_path(nlpath, lpath, dent->d_name);
+      estimate_sides(nfpath, nlpath, depth + 1, fcount, lcount);
+    }
+  }
+  closedir(fdir);
+}
+
+/**
+ * Check whether a path on the root side resolves to the
+ * project path it maps from through any number of links
+ */
+int resolves_to_project(
+    const char *lpath, const char *fpath, const char *prefix
+) {
+  char resolved[PATH_MAX + 1];
+  if (realpath(lpath, resolved) == NULL) {
+    // Dangling links aren't linked
+    return 0;
+  }
+  // Project paths are always relative
+  // and start with the current "./"
+  char expected[PATH_MAX + 1];
+  join_path(expected, prefix, &fpath[2]);
+  return !strcmp(resolved, expected);
+}
+
+/**
+ * Remove "." and ".." components from an absolute path in
+ * place without resolving anything along the way
+ */
+void normalize_path(char *path) {
+  char *out = path;
+  const char *in = path;
+  while (*in) {
+    while (*in == '/') {
+      in++;
+    }
+    const char *end = strchrnul(in, '/');
+    size_t length = end - in;
+    if (length == 1 && in[0] == '.') {
+      // Current directory adds nothing
+    } else if (length == 2 && in[0] == '.' && in[1] == '.') {
+      while (out > path && *--out != '/') {
+      }
+    } else if (length) {
+      *out++ = '/';
+      memmove(out, in, length);
+      out += length;
+    }
+    in = end;
+  }
+  if (out == path) {
+    *out++ = '/';
+  }
+  *out = '\0';
+}
+
+/**
+ * Read where a link points as an absolute path, where relative
+ * targets are joined onto the directory holding the link without
+ * resolving anything since the target might not exist anymore.
+ * Returns 1 when the path isn't a link.
+ */
+int read_link_target(const char *lpath, char *target) {
+  char buf[PATH_MAX + 1];
+  ssize_t length = readlink(lpath, buf, PATH_MAX);
+  if (length == -1) {
+    return 1;
+  }
+  buf[length] = '\0';
+  if (buf[0] == '/') {
+    strcpy(target, buf);
+    return 0;
+  }
+  // Relative link paths can't be
+  // resolved without a directory
+  const char *slash = strrchr(lpath, '/');
+  if (slash == NULL) {
+    return 1;
+  }
+  int dirlen = slash - lpath;
+  if (snprintf(target, PATH_MAX + 1, "%.*s/%s", dirlen, lpath, buf) >
+      PATH_MAX) {
+    return 1;
+  }
+  normalize_path(target);
+  return 0;
+}
+
+/**
+ * Check whether a path is a link to exactly the given target
+ * whether the link itself is absolute or relative
+ */
+int is_link_to(const char *lpath, const char *target) {
+  char buf[PATH_MAX + 1];
+  return !read_link_target(lpath, buf) && !strcmp(buf, target);
+}
+
+
+/**
+ * List everything beneath a linked project directory
+ * since all of its entries are reachable through the link
+ */
+void treat_linked_subtree(const char *fpath, const char *lpath) {
+  DIR *dir = open_directory(fpath);
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent *dent;
+  while ((dent = readdir(dir)) != NULL) {
+    char nfpath[PATH_MAX + 1];
+    join_path(nfpath, fpath, dent->d_name);
+    if (is_dot_entry(dent->d_name) || !is_directory_allowed(nfpath) ||
+        !may_select(nfpath)) {
+      continue;
+    }
+    pace_background();
+    char nlpath[PATH_MAX + 1];
+    join_path(nlpath, lpath, dent->d_name);
+    if (is_entry_selected(nfpath)) {
+      print_linked_entry(nlpath);
+    }
+    if (get_entry_type(dent, nfpath) == DT_DIR) {
+      treat_linked_subtree(nfpath, nlpath);
+    }
+  }
+  closedir(dir);
+}
+
+// Directories being walked on either side so
+// links looping back up aren't followed again
+typedef struct ancestor {
+  dev_t dev;
+  ino_t ino;
+  const struct ancestor *parent;
+} ancestor_t;
+
+/**
+ * Check whether a directory is already being walked
+ */
+int is_ancestor(const ancestor_t *parent, const struct stat *sb) {
+  for (const ancestor_t *a = parent; a; a = a->parent) {
+    if (a->dev == sb->st_dev && a->ino == sb->st_ino) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Walk the root side looking only for links resolving back into
+ * the project, descending into directories found on both sides
+ * including root directories which are links themselves
+ */
+void walk_root_side(
+    const char *fpath, const char *lpath, const char *prefix,
+    const ancestor_t *parent
+) {
+  DIR *dir = open_directory(lpath);
+  // Nothing can be linked
+  // beneath a missing directory
+  if (dir == NULL) {
+    return;
+  }
+  struct stat sb;
+  if (fstat(dirfd(dir), &sb) == -1 || is_ancestor(parent, &sb)) {
+    closedir(dir);
+    return;
+  }
+  ancestor_t self = {sb.st_dev, sb.st_ino, parent};
+  struct dirent *dent;
+  while ((dent = readdir(dir)) != NULL) {
+    char nfpath[PATH_MAX + 1];
+    join_path(nfpath, fpath, dent->d_name);
+    if (is_dot_entry(dent->d_name) || !is_directory_allowed(nfpath) ||
+        !may_select(nfpath)) {
+      continue;
+    }
+    pace_background();
+    char nlpath[PATH_MAX + 1];
+    join_path(nlpath, lpath, dent->d_name);
+    unsigned char type = get_entry_type(dent, nlpath);
+    struct stat fsb, lsb;
+    // Links can reach the project through other links
+    // so only their fully resolved paths are compared
+    if (type == DT_LNK && resolves_to_project(nlpath, nfpath, prefix)) {
+      if (is_entry_selected(nfpath)) {
+        print_linked_entry(nlpath);
+      }
+      if (stat(nfpath, &fsb) == 0 && S_ISDIR(fsb.st_mode)) {
+        treat_linked_subtree(nfpath, nlpath);
+      }
+    } else if (type == DT_DIR ||
+               (type == DT_LNK && stat(nlpath, &lsb) == 0 &&
+                S_ISDIR(lsb.st_mode))) {
+      // Only descend where the
+      // project mirrors the root
+      if (lstat(nfpath, &fsb) == 0 && S_ISDIR(fsb.st_mode)) {
+        walk_root_side(nfpath, nlpath, prefix, &self);
+      }
+    }
+  }
+  closedir(dir);
+}
+
+/**
+ * List a single project entry using its system location
+ * when linked and its project location otherwise
+ */
+void list_entry(const char *fpath) {
+  pace_background();
+  struct stat fsb, lsb;
+  int errfile = get_file_stats(fpath, &fsb);
+  if (errfile) {
+    fprintf(stderr, "Non-existent file `%s'\n", fpath);
+    exit(EXIT_FAILURE);
+  }
+  char *lpath = make_link_path(fpath);
+  int errlink = get_link_stats(lpath, &lsb);
+  // Using fstat for both files and links to see if
+  // the actual file stats are the same for both. This
+  // doesn't distinguish between a link and a file.
+  if (errlink == -1) {
+    // Could be linked so always shown
+    printf(YELLOW("%s") "\n", lpath);
+  } else if (!errlink && fsb.st_ino == lsb.st_ino) {
+    print_linked_entry(lpath);
+  } else if (!glist_opts.lflag) {
+    // Don't care about unlinked owners
+    printf("%s\n", fpath);
+  }
+  free(lpath);
+}
+
 /**
  * Handle a file or directory entry based on
  * global list options and log to stdout
  */
 int treat_entry(
-    const char *fpath, UNUSED const struct stat *sb, UNUSED int tflag
+    const char *fpath,
+    UNUSED const struct stat *sb,
+    int tflag,
+    UNUSED struct FTW *ftwbuf
 ) {
-  if (is_directory_allowed(fpath)) {
-    struct stat fsb, lsb;
-    int errfile = get_file_stats(fpath, &fsb);
-    if (errfile) {
-      fprintf(stderr, "Non-existent file `%s'\n", fpath);
-      exit(EXIT_FAILURE);
+  // Prune directories when nothing
+  // beneath them could be listed
+  if (tflag == FTW_D && strcmp(fpath, CURRENT_DIRECTORY) &&
+      (!is_directory_allowed(fpath) || !may_select(fpath))) {
+    return FTW_SKIP_SUBTREE;
+  }
+  if (is_directory_allowed(fpath) && is_entry_selected(fpath)) {
+    list_entry(fpath);
+  }
+  return FTW_CONTINUE;
+}
+
+/**
+ * Walk the project side visiting each directory before its
+ * entries like nftw does, but opening directories ourselves
+ * so background walks don't update their access times
+ */
+void walk_project_side(const char *fpath, const ancestor_t *parent) {
+  struct stat sb;
+  int isdir = stat(fpath, &sb) == 0 && S_ISDIR(sb.st_mode);
+  if (isdir && strcmp(fpath, CURRENT_DIRECTORY) &&
+      (!is_directory_allowed(fpath) || !may_select(fpath))) {
+    return;
+  }
+  if (is_directory_allowed(fpath) && is_entry_selected(fpath)) {
+    list_entry(fpath);
+  }
+  if (!isdir) {
+    return;
+  }
+  if (is_ancestor(parent, &sb)) {
+    return;
+  }
+  ancestor_t self = {sb.st_dev, sb.st_ino, parent};
+  DIR *dir = open_directory(fpath);
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent *dent;
+  while ((dent = readdir(dir)) != NULL) {
+    if (!is_dot_entry(dent->d_name)) {
+      char nfpath[PATH_MAX + 1];
+      join_path(nfpath, fpath, dent->d_name);
+      walk_project_side(nfpath, &self);
     }
-    char *lpath = make_link_path(fpath);
-    int errlink = get_file_stats(lpath, &lsb);
-    // Using fstat for both files and links to see if
-    // the actual file stats are the same for both. This
-    // doesn't distinguish between a link and a file.
-    if (!errlink && fsb.st_ino == lsb.st_ino) {
-      if (glist_opts.oflag) {
-        char *owner = get_link_owner(lpath);
-        printf(GREEN("%s %s\n"), owner, lpath);
-      } else {
-        printf(GREEN("%s") "\n", lpath);
+  }
+  closedir(dir);
+}
+
+/**
+ * Handle the winning entry across layers when listing
+ * where filters match paths relative to every layer
+ */
+int list_layer_entry(
+    const char *fpath, const char *rpath, int isdir, UNUSED int merged
+) {
+  char ppath[PATH_MAX + 1];
+  join_path(ppath, CURRENT_DIRECTORY, rpath);
+  if (!is_directory_allowed(ppath) || !may_select(ppath)) {
+    return 0;
+  }
+  if (is_entry_selected(ppath)) {
+    list_entry(fpath);
+  }
+  return isdir;
+}
+
+/**
+ * List linked entries for a project path starting from the root
+ * side, where the path itself may already be linked directly or
+ * through any of its parent directories
+ */
+void list_root_side(const char *fpath, const char *lpath) {
+  if (strcmp(fpath, CURRENT_DIRECTORY) &&
+      resolves_to_project(lpath, fpath, gprefix)) {
+    if (is_entry_selected(fpath)) {
+      print_linked_entry((char *)lpath);
+    }
+    struct stat fsb;
+    if (stat(fpath, &fsb) == 0 && S_ISDIR(fsb.st_mode)) {
+      treat_linked_subtree(fpath, lpath);
+    }
+    return;
+  }
+  walk_root_side(fpath, lpath, gprefix, NULL);
+}
+
+/**
+ * List a project path and everything beneath it, choosing
+ * which side of the mapping to walk for linked entries
+ */
+void list_path(const char *fpath, side_t side) {
+  // Only links are listed so we can choose to find
+  // them starting from either side of the mapping.
+  // Reading root directories can't be bounded by
+  // probes so deadlines keep us on the project side.
+  if (glist_opts.lflag && side != PROJECT_SIDE && !gprobe_timeout) {
+    resolve_prefixes();
+    if (!groot_exists) {
+      // Nothing linked without a root
+      return;
+    }
+    char lpath[PATH_MAX + 1];
+    if (strcmp(fpath, CURRENT_DIRECTORY)) {
+      join_path(lpath, groot, get_relative_path(fpath));
+    } else {
+      strcpy(lpath, groot);
+    }
+    if (side == AUTO_SIDE) {
+      // Each project entry costs a few probes while each
+      // overlapping root entry only costs reading it
+      size_t fcount = 0, lcount = 0;
+      estimate_sides(fpath, lpath, 1, &fcount, &lcount);
+      if (lcount < fcount) {
+        side = ROOT_SIDE;
       }
-    } else if (!glist_opts.lflag) {
-      // Don't care about unlinked owners
-      printf("%s\n", fpath);
     }
-    free(lpath);
+    if (side == ROOT_SIDE) {
+      list_root_side(fpath, lpath);
+      return;
+    }
+  }
+  if (is_background()) {
+    walk_project_side(fpath, NULL);
+    return;
+  }
+  // Concurrently handle 20 entries at a time
+  if (nftw(fpath, treat_entry, 20, FTW_ACTIONRETVAL) == -1) {
+    fprintf(stderr, "Error walking directory\n");
+    exit(EXIT_FAILURE);
   }
-  return 0;
 }
 
 /**
@@ -297,10 +1034,12 @@ void treat_none(int argc, char **argv) {
 }
 
 /**
- * Unlinks a link, deletes a file, or removes
- * a directory depending on the given path
+ * Unlinks a link, deletes a file, or removes a directory
+ * depending on the given path. Returns 1 when the link is
+ * left for the privileged helper to remove later, printing
+ * any message given once it's removed.
  */
-void attempt_unlink(char *fpath) {
+int attempt_unlink(char *fpath, const char *message) {
   // Check the file actually exists
   // Only unlink if we have a preimage
   struct stat fsb;
@@ -313,24 +1052,160 @@ void attempt_unlink(char *fpath) {
   // Check if the link actually exists
   struct stat lsb;
   int errlink = get_file_stats(lpath, &lsb);
+  if (errlink && is_resuming()) {
+    // Removed after the last checkpoint
+    free(lpath);
+    return 0;
+  }
   if (errlink) {
     fprintf(stderr, "Non-existent link path `%s'\n", lpath);
     exit(EXIT_FAILURE);
   }
   // Specify the full path
   int errunlink = remove(lpath);
+  // Root-owned directories are left for the
+  // helper so everything else runs unprivileged
+  if (errunlink && errno == EACCES) {
+    escalate_unlink(lpath, message);
+    free(lpath);
+    return 1;
+  }
   if (errunlink) {
     perror("Issue unlinking path");
     fprintf(stderr, "Couldn't unlink path `%s'\n", lpath);
     exit(EXIT_FAILURE);
   }
   free(lpath);
+  return 0;
+}
+
+/**
+ * Create a directory along with any missing parents, starting
+ * with the deepest and only moving up when a parent is missing
+ */
+int make_directories(char *dpath) {
+  if (mkdir(dpath, 0777) == -1) {
+    if (errno == ENOENT) {
+      char *slash = strrchr(dpath, '/');
+      if (slash == NULL || slash == dpath) {
+        return -1;
+      }
+      // Temporarily cut the path
+      // down to its parent
+      *slash = '\0';
+      int errparent = make_directories(dpath);
+      *slash = '/';
+      if (errparent || (mkdir(dpath, 0777) == -1 && errno != EEXIST)) {
+        return -1;
+      }
+    } else if (errno != EEXIST) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Create all missing parent directories for a link path
+ */
+int make_parent_directories(const char *lpath) {
+  char dpath[PATH_MAX + 1];
+  snprintf(dpath, PATH_MAX + 1, "%s", lpath);
+  char *slash = strrchr(dpath, '/');
+  if (slash == NULL || slash == dpath) {
+    // Root always exists
+    return 0;
+  }
+  *slash = '\0';
+  return make_directories(dpath);
+}
+
+/**
+ * Make the shortest relative path from the directory holding a
+ * link to the file it links to, preferring the real directory
+ * when it exists since the link is resolved from there. Falls
+ * back to the absolute path when the relative one is too long.
+ */
+void make_relative_target(char *buf, const char *fabspath, const char *lpath) {
+  char dpath[PATH_MAX + 1];
+  snprintf(dpath, PATH_MAX + 1, "%s", lpath);
+  char *slash = strrchr(dpath, '/');
+  if (slash == dpath) {
+    slash++;
+  }
+  *slash = '\0';
+  char rdpath[PATH_MAX + 1];
+  if (realpath(dpath, rdpath) == NULL) {
+    strcpy(rdpath, dpath);
+  }
+  // Find the deepest directory shared
+  // by the link and the file it links to
+  size_t common = 0;
+  size_t i = 0;
+  while (rdpath[i] && rdpath[i] == fabspath[i]) {
+    if (rdpath[i++] == '/') {
+      common = i;
+    }
+  }
+  // The link's directory is an ancestor
+  // so nothing needs to be climbed
+  if (rdpath[i] == '\0' && fabspath[i] == '/') {
+    snprintf(buf, PATH_MAX + 1, "%s", &fabspath[i + 1]);
+    return;
+  }
+  size_t length = 0;
+  for (const char *pos = &rdpath[common]; *pos; pos++) {
+    if (pos == &rdpath[common] || (*pos == '/' && pos[1])) {
+      if (length + 3 > PATH_MAX) {
+        strcpy(buf, fabspath);
+        return;
+      }
+      memcpy(&buf[length], "../", 3);
+      length += 3;
+    }
+  }
+  if (length + strlen(&fabspath[common]) > PATH_MAX) {
+    strcpy(buf, fabspath);
+    return;
+  }
+  strcpy(&buf[length], &fabspath[common]);
+}
+
+/**
+ * Count links created this run along with
+ * those with targets stored inline
+ */
+void count_inline_link(const char *target) {
+  glinks_made++;
+  if (strlen(target) < INLINE_LINK_SIZE) {
+    ginline_links++;
+  }
+}
+
+/**
+ * Print how many links created this run keep
+ * their targets inline rather than in a block
+ */
+void print_inline_links(void) {
+  fprintf(stderr, "%d of %d links fit inline\n", ginline_links, glinks_made);
 }
 
 /**
- * Tracks a link, meaning creates it
+ * Queue a link for the privileged helper to create
+ * along with the line printed once it's created
  */
-void add_link(char *fpath, char *lpath, link_opts_t *opts) {
+void escalate_link_path(const char *target, const char *lpath) {
+  char message[PATH_MAX + 16];
+  snprintf(message, sizeof(message), GREEN("%s"), lpath);
+  escalate_link(target, lpath, message);
+  count_inline_link(target);
+}
+
+/**
+ * Tracks a link, meaning creates it. Returns 1 when the link
+ * is left for the privileged helper to create later.
+ */
+int add_link(char *fpath, char *lpath, link_opts_t *opts) {
   // Check the file actually exists
   struct stat fsb;
   int errfile = get_file_stats(fpath, &fsb);
@@ -341,14 +1216,50 @@ void add_link(char *fpath, char *lpath, link_opts_t *opts) {
   char fabspath[PATH_MAX + 1];
   realpath(fpath, fabspath);
   // Specify the full path because locations are relative
-  // to directory of the link. This implicitly throws when
+  // to directory of the link, unless asked for the shortest
+  // relative path instead. This implicitly throws when
   // trying to relink a file that's already linked.
-  int errlink = symlink(fabspath, lpath);
+  char target[PATH_MAX + 1];
+  if (opts->cflag) {
+    make_relative_target(target, fabspath, lpath);
+  } else {
+    strcpy(target, fabspath);
+  }
+  int errlink = symlink(target, lpath);
+  // Only creating missing parents when asked
+  // and only after finding out they're missing
+  if (errlink && errno == ENOENT && opts->pflag) {
+    if (make_parent_directories(lpath)) {
+      perror("Issue creating parent directories");
+      fprintf(stderr, "Couldn't create parents for `%s'\n", lpath);
+      exit(EXIT_FAILURE);
+    }
+    // Parents might resolve differently
+    // now that they actually exist
+    if (opts->cflag) {
+      make_relative_target(target, fabspath, lpath);
+    }
+    errlink = symlink(target, lpath);
+  }
+  // Linked after the last checkpoint
+  if (errlink && errno == EEXIST && is_resuming() &&
+      is_link_to(lpath, fabspath)) {
+    return 0;
+  }
+  // Root-owned directories are left for the
+  // helper so everything else runs unprivileged
+  if (errlink && errno == EACCES) {
+    escalate_link_path(target, lpath);
+    return 1;
+  }
   if (errlink) {
     if (errno == EEXIST && opts->fflag) {
       // Useful when downgrading permissions
-      attempt_unlink(fpath);
-      int nerrlink = symlink(fabspath, lpath);
+      if (attempt_unlink(fpath, NULL)) {
+        escalate_link_path(target, lpath);
+        return 1;
+      }
+      int nerrlink = symlink(target, lpath);
       if (nerrlink) {
         perror("Issue creating forced link");
         fprintf(stderr, "Couldn't force link file `%s'\n", fpath);
@@ -360,6 +1271,60 @@ void add_link(char *fpath, char *lpath, link_opts_t *opts) {
       exit(EXIT_FAILURE);
     }
   }
+  count_inline_link(target);
+  return 0;
+}
+
+/**
+ * Handle the winning entry across layers when linking where
+ * directories shared by many layers are linked entry by entry
+ */
+int link_layer_entry(
+    const char *fpath, const char *rpath, UNUSED int isdir, int merged
+) {
+  char ppath[PATH_MAX + 1];
+  join_path(ppath, CURRENT_DIRECTORY, rpath);
+  if (!is_directory_allowed(ppath)) {
+    return 0;
+  }
+  if (merged) {
+    return 1;
+  }
+  if (skip_entry(ppath)) {
+    return 0;
+  }
+  char *lpath = make_link_path(fpath);
+  if (!add_link((char *)fpath, lpath, &glink_opts)) {
+    printf(GREEN("%s") "\n", lpath);
+  }
+  free(lpath);
+  complete_entry(ppath);
+  return 0;
+}
+
+/**
+ * Handle the winning entry across layers when unlinking
+ * mirroring how entries were linked in the first place
+ */
+int unlink_layer_entry(
+    const char *fpath, const char *rpath, UNUSED int isdir, int merged
+) {
+  char ppath[PATH_MAX + 1];
+  join_path(ppath, CURRENT_DIRECTORY, rpath);
+  if (!is_directory_allowed(ppath)) {
+    return 0;
+  }
+  if (merged) {
+    return 1;
+  }
+  if (skip_entry(ppath)) {
+    return 0;
+  }
+  if (!attempt_unlink((char *)fpath, fpath)) {
+    printf("%s\n", fpath);
+  }
+  complete_entry(ppath);
+  return 0;
 }
 
 /**
@@ -375,32 +1340,49 @@ void treat_link(int argc, char **argv) {
   if (ghidden_opts.dflag) {
     print_link_options(argc, argv, &opts);
   }
+  glink_opts = opts;
   // Current should be LINK and next should be local path
   // so if we don't have an argument just show the help
   if (++subind >= argc) {
     print_link_usage(argv);
     exit(EXIT_SUCCESS);
   }
-  // The next argument is invalid since
-  // we only accept a single argument
-  if (++subind < argc) {
-    fprintf(stderr, "Invalid link non-option `%s'\n", argv[subind]);
-    exit(EXIT_FAILURE);
-  }
-  // Reset for future use
-  subind--;
   // We give priority to certain options
   // and stop executing depending
   if (opts.hflag) {
     print_link_usage(argv);
     exit(EXIT_SUCCESS);
   }
-  // Actually add the link
-  char *fpath = argv[subind];
-  char *lpath = make_link_path(fpath);
-  add_link(fpath, lpath, &opts);
-  printf(GREEN("%s") "\n", lpath);
-  free(lpath);
+  // Bulk runs are journaled so a run dying
+  // partway can continue where it left off
+  start_journal("link", &argv[subind], argc - subind, opts.rflag);
+  // Actually add the links where many paths
+  // can share parents created along the way
+  for (; subind < argc; subind++) {
+    if (get_layer_count() > 1) {
+      char *rpath = make_layer_relative_path(argv[subind]);
+      treat_layered_path(rpath, link_layer_entry);
+      free(rpath);
+      continue;
+    }
+    char *fpath = argv[subind];
+    if (skip_entry(fpath)) {
+      continue;
+    }
+    char *lpath = make_link_path(fpath);
+    if (!add_link(fpath, lpath, &opts)) {
+      printf(GREEN("%s") "\n", lpath);
+    }
+    free(lpath);
+    complete_entry(fpath);
+  }
+  // Denied links are created in one
+  // batch once everything else is done
+  run_escalations(groot);
+  finish_journal();
+  if (opts.cflag) {
+    print_inline_links();
+  }
 }
 
 /**
@@ -436,10 +1418,27 @@ void treat_unlink(int argc, char **argv) {
     print_unlink_usage(argv);
     exit(EXIT_SUCCESS);
   }
+  // Layered folders unlink entry by entry
+  // so those runs are journaled as well
+  start_journal("unlink", &argv[subind], 1, opts.rflag);
+  if (get_layer_count() > 1) {
+    char *rpath = make_layer_relative_path(argv[subind]);
+    treat_layered_path(rpath, unlink_layer_entry);
+    free(rpath);
+    run_escalations(groot);
+    finish_journal();
+    return;
+  }
   // Actually remove the link
   char *fpath = argv[subind];
-  attempt_unlink(fpath);
-  printf("%s\n", fpath);
+  if (!skip_entry(fpath)) {
+    if (!attempt_unlink(fpath, fpath)) {
+      printf("%s\n", fpath);
+    }
+    complete_entry(fpath);
+  }
+  run_escalations(groot);
+  finish_journal();
 }
 
 /**
@@ -454,23 +1453,273 @@ void treat_list(int argc, char **argv) {
   if (ghidden_opts.dflag) {
     print_list_options(argc, argv, &glist_opts);
   }
-  // Current should be LIST so next
-  // is invalid if within limit
-  if (++subind < argc) {
-    fprintf(stderr, "Invalid list non-option `%s'\n", argv[subind]);
-    exit(EXIT_FAILURE);
-  }
   // We give priority to certain options
   // and stop executing depending
   if (glist_opts.hflag) {
     print_list_usage(argv);
     exit(EXIT_SUCCESS);
   }
-  // Concurrently handle 20 entries at a time
-  if (ftw(CURRENT_DIRECTORY, treat_entry, 20) == -1) {
-    fprintf(stderr, "Error walking directory\n");
+  side_t side = AUTO_SIDE;
+  if (glist_opts.svalue) {
+    side = map_side(glist_opts.svalue);
+  }
+  if (glist_opts.tvalue) {
+    char *end;
+    long timeout = strtol(glist_opts.tvalue, &end, 10);
+    if (*end != '\0' || timeout <= 0 || timeout > INT_MAX) {
+      fprintf(stderr, "Invalid timeout `%s'\n", glist_opts.tvalue);
+      exit(EXIT_FAILURE);
+    }
+    gprobe_timeout = (int)timeout;
+  }
+  // Entered before walking anything so
+  // every probe runs in the background
+  if (glist_opts.bflag) {
+    enter_background();
+  }
+  // Layers are merged in a single walk taking
+  // precedence over any choice of side
+  if (get_layer_count() > 1) {
+    if (++subind >= argc) {
+      walk_layers("", list_layer_entry);
+    }
+    for (; subind < argc; subind++) {
+      char *rpath = make_layer_relative_path(argv[subind]);
+      treat_layered_path(rpath, list_layer_entry);
+      free(rpath);
+    }
+    print_slow_directories();
+    return;
+  }
+  // Current should be LIST and the rest are paths
+  // scoping the walk, otherwise walk the project
+  if (++subind >= argc) {
+    list_path(CURRENT_DIRECTORY, side);
+  }
+  for (; subind < argc; subind++) {
+    char *fpath = make_project_path(argv[subind]);
+    list_path(fpath, side);
+    free(fpath);
+  }
+  print_slow_directories();
+}
+
+/**
+ * Collect a path changed between revisions to treat once
+ * the whole diff is known since renames span two entries
+ */
+void collect_change(
+    const char *rpath, change_t change, const unsigned char *sha, int isdir
+) {
+  size_t size = (gsync_count + 1) * sizeof(sync_change_t);
+  gsync_changes = (sync_change_t *)realloc(gsync_changes, size);
+  if (gsync_changes == NULL) {
+    fprintf(stderr, "Failure allocating changes\n");
+    exit(EXIT_FAILURE);
+  }
+  sync_change_t *entry = &gsync_changes[gsync_count++];
+  entry->rpath = strdup(rpath);
+  entry->change = change;
+  memcpy(entry->sha, sha, GIT_SHA_LENGTH);
+  entry->isdir = isdir;
+  entry->linked = 0;
+}
+
+/**
+ * Check whether a root path is a link made for exactly the
+ * project path it maps from without resolving anything, since
+ * removed project paths no longer exist to be resolved
+ */
+int is_link_from_project(const char *lpath, const char *rpath) {
+  char expected[PATH_MAX + 1];
+  join_path(expected, gprefix, rpath);
+  return is_link_to(lpath, expected);
+}
+
+/**
+ * Check whether the root directory a path maps into already
+ * holds links to siblings from the same project directory,
+ * remembering the last directory since siblings come together
+ */
+int holds_project_links(const char *rpath) {
+  static char last[PATH_MAX + 1];
+  static int cached = 0;
+  static int held = 0;
+  char parent[PATH_MAX + 1];
+  snprintf(parent, PATH_MAX + 1, "%s", rpath);
+  char *slash = strrchr(parent, '/');
+  *(slash ? slash : parent) = '\0';
+  if (cached && !strcmp(last, parent)) {
+    return held;
+  }
+  strcpy(last, parent);
+  cached = 1;
+  held = 0;
+  char dpath[PATH_MAX + 1];
+  char prefix[PATH_MAX + 1];
+  if (*parent) {
+    join_path(dpath, groot, parent);
+    join_path(prefix, gprefix, parent);
+  } else {
+    strcpy(dpath, groot);
+    strcpy(prefix, gprefix);
+  }
+  strncat(prefix, "/", PATH_MAX - strlen(prefix));
+  DIR *dir = opendir(dpath);
+  if (dir == NULL) {
+    return held;
+  }
+  struct dirent *dent;
+  while (!held && (dent = readdir(dir)) != NULL) {
+    char lpath[PATH_MAX + 1];
+    join_path(lpath, dpath, dent->d_name);
+    if (is_dot_entry(dent->d_name) || get_entry_type(dent, lpath) != DT_LNK) {
+      continue;
+    }
+    char target[PATH_MAX + 1];
+    if (read_link_target(lpath, target)) {
+      continue;
+    }
+    held = !strncmp(target, prefix, strlen(prefix));
+  }
+  closedir(dir);
+  return held;
+}
+
+/**
+ * Decide whether an added path should be linked, which is the
+ * case when it's renamed from a linked path with the same content
+ * or when adopting it since its siblings are linked already
+ */
+int should_link_added(const sync_change_t *added, int adopt) {
+  for (int i = 0; i < gsync_count; i++) {
+    const sync_change_t *removed = &gsync_changes[i];
+    if (removed->change == REMOVED && removed->linked &&
+        removed->isdir == added->isdir &&
+        !memcmp(removed->sha, added->sha, GIT_SHA_LENGTH)) {
+      return 1;
+    }
+  }
+  return adopt && holds_project_links(added->rpath);
+}
+
+/**
+ * Check whether a root path already reaches the project
+ * path, like entries beneath a linked directory do
+ */
+int reaches_project_path(const char *fpath, const char *lpath) {
+  struct stat fsb, lsb;
+  if (stat(fpath, &fsb) == -1 || stat(lpath, &lsb) == -1) {
+    return 0;
+  }
+  return fsb.st_dev == lsb.st_dev && fsb.st_ino == lsb.st_ino;
+}
+
+/**
+ * Handle SYNC command
+ */
+void treat_sync(int argc, char **argv) {
+  sync_opts_t opts = {0};
+  int subind = 0;
+  if (set_sync_options(argc, argv, &opts, &subind) != 0) {
+    fprintf(stderr, "Failure setting sync options\n");
     exit(EXIT_FAILURE);
   }
+  if (ghidden_opts.dflag) {
+    print_sync_options(argc, argv, &opts);
+  }
+  // We give priority to certain options
+  // and stop executing depending
+  if (opts.hflag || opts.svalue == NULL) {
+    print_sync_usage(argv);
+    exit(EXIT_SUCCESS);
+  }
+  // Current should be SYNC with nothing after
+  if (++subind < argc) {
+    fprintf(stderr, "Invalid sync non-option `%s'\n", argv[subind]);
+    exit(EXIT_FAILURE);
+  }
+  if (get_layer_count() > 1) {
+    fprintf(stderr, "Layers can't be synced `%s'\n", ghidden_opts.lvalues[0]);
+    exit(EXIT_FAILURE);
+  }
+  resolve_prefixes();
+  if (!groot_exists) {
+    // Nothing linked without a root
+    return;
+  }
+  diff_revisions(GIT_DIRECTORY, opts.svalue, HEAD_REVISION, collect_change);
+  // Every decision is made before changing anything
+  // where removed entries are decided first since
+  // renamed entries follow whatever they were
+  for (int i = 0; i < gsync_count; i++) {
+    sync_change_t *change = &gsync_changes[i];
+    if (change->change == REMOVED) {
+      char lpath[PATH_MAX + 1];
+      join_path(lpath, groot, change->rpath);
+      change->linked = is_link_from_project(lpath, change->rpath);
+    }
+  }
+  // Added directories come before their entries so
+  // we skip entries beneath an added directory link
+  const char *linked_dir = NULL;
+  for (int i = 0; i < gsync_count; i++) {
+    sync_change_t *change = &gsync_changes[i];
+    char fpath[PATH_MAX + 1];
+    join_path(fpath, CURRENT_DIRECTORY, change->rpath);
+    if (change->change != ADDED || !is_directory_allowed(fpath)) {
+      continue;
+    }
+    size_t length = linked_dir ? strlen(linked_dir) : 0;
+    if (linked_dir && !strncmp(change->rpath, linked_dir, length) &&
+        change->rpath[length] == '/') {
+      continue;
+    }
+    change->linked = should_link_added(change, opts.aflag);
+    if (change->linked && change->isdir) {
+      linked_dir = change->rpath;
+    }
+  }
+  for (int i = 0; i < gsync_count; i++) {
+    sync_change_t *change = &gsync_changes[i];
+    if (change->change != REMOVED || !change->linked) {
+      continue;
+    }
+    char lpath[PATH_MAX + 1];
+    join_path(lpath, groot, change->rpath);
+    char fpath[PATH_MAX + 1];
+    join_path(fpath, CURRENT_DIRECTORY, change->rpath);
+    int errunlink = remove(lpath);
+    if (errunlink && errno == EACCES) {
+      escalate_unlink(lpath, fpath);
+      continue;
+    }
+    if (errunlink) {
+      perror("Issue unlinking path");
+      fprintf(stderr, "Couldn't unlink path `%s'\n", lpath);
+      exit(EXIT_FAILURE);
+    }
+    printf("%s\n", fpath);
+  }
+  // Missing parents are expected when
+  // syncing so they're always created
+  link_opts_t lopts = {0};
+  lopts.pflag = 1;
+  for (int i = 0; i < gsync_count; i++) {
+    sync_change_t *change = &gsync_changes[i];
+    if (change->change != ADDED || !change->linked) {
+      continue;
+    }
+    char fpath[PATH_MAX + 1];
+    join_path(fpath, CURRENT_DIRECTORY, change->rpath);
+    char *lpath = make_link_path(fpath);
+    if (!reaches_project_path(fpath, lpath) &&
+        !add_link(fpath, lpath, &lopts)) {
+      printf(GREEN("%s") "\n", lpath);
+    }
+    free(lpath);
+  }
+  run_escalations(groot);
 }
 
 /**
@@ -487,6 +1736,9 @@ void treat_command(char *command, int argc, char **argv) {
     case LIST:
       treat_list(argc, argv);
       break;
+    case SYNC:
+      treat_sync(argc, argv);
+      break;
     case UNLINK:
       treat_unlink(argc, argv);
       break;
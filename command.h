@@ -5,7 +5,9 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
-typedef enum { NONE, LINK, LIST, UNLINK } command_t;
+typedef enum { NONE, LINK, LIST, SYNC, UNLINK } command_t;
+
+typedef enum { AUTO_SIDE, PROJECT_SIDE, ROOT_SIDE } side_t;
 
 void treat_command(char *command, int argc, char **argv);
 
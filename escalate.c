@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include "escalate.h"
+#include "journal.h"
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Run with privileges through the escalation command, which is
+// sudo unless given by STUFF_ESCALATE, only from a root-owned
+// install path fixed at build time. An empty value runs the
+// helper built next to stuff directly without privileges.
+#ifndef HELPER_PATH
+#define HELPER_PATH "/usr/local/libexec/stuff-helper"
+#endif
+static const char *HELPER_NAME = "stuff-helper";
+static const char *DEFAULT_ESCALATE = "sudo";
+
+// Most whitespace separated words taken from STUFF_ESCALATE
+// so commands like "sudo -n" can pass their own options
+#define MAX_ESCALATE_ARGS 16
+
+// A link or unlink denied to us
+// along with what to print once it's done
+typedef struct {
+  int unlink;
+  char *target;
+  char *lpath;
+  char *message;
+} escalation_t;
+
+static escalation_t *gescalations = NULL;
+static int gescalation_count = 0;
+
+/**
+ * Queue an operation for the helper
+ */
+static void queue_escalation(
+    int unlink, const char *target, const char *lpath, const char *message
+) {
+  size_t size = (gescalation_count + 1) * sizeof(escalation_t);
+  gescalations = (escalation_t *)realloc(gescalations, size);
+  if (gescalations == NULL) {
+    fprintf(stderr, "Failure allocating escalations\n");
+    exit(EXIT_FAILURE);
+  }
+  escalation_t *escalation = &gescalations[gescalation_count++];
+  escalation->unlink = unlink;
+  escalation->target = target ? strdup(target) : NULL;
+  escalation->lpath = strdup(lpath);
+  escalation->message = message ? strdup(message) : NULL;
+  hold_journal();
+}
+
+/**
+ * Queue a link we weren't allowed to create ourselves
+ */
+void escalate_link(const char *target, const char *lpath, const char *message) {
+  queue_escalation(0, target, lpath, message);
+}
+
+/**
+ * Queue a link we weren't allowed to remove ourselves
+ */
+void escalate_unlink(const char *lpath, const char *message) {
+  queue_escalation(1, NULL, lpath, message);
+}
+
+/**
+ * Write a whole NUL terminated field to the helper
+ */
+static int write_field(int fd, const char *field) {
+  size_t length = strlen(field) + 1;
+  while (length > 0) {
+    ssize_t written = write(fd, field, length);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written == -1) {
+      return -1;
+    }
+    field += written;
+    length -= written;
+  }
+  return 0;
+}
+
+/**
+ * Find the helper built next to the running binary
+ * which is only ever run without privileges
+ */
+static void find_helper(char *hpath) {
+  char epath[PATH_MAX + 1];
+  ssize_t length = readlink("/proc/self/exe", epath, PATH_MAX);
+  if (length == -1) {
+    perror("Issue finding helper");
+    exit(EXIT_FAILURE);
+  }
+  epath[length] = '\0';
+  char *slash = strrchr(epath, '/');
+  *slash = '\0';
+  if (snprintf(hpath, PATH_MAX + 1, "%s/%s", epath, HELPER_NAME) > PATH_MAX) {
+    fprintf(stderr, "Couldn't find helper `%s'\n", HELPER_NAME);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * Refuse to run the installed helper with privileges unless it
+ * and every directory above it are owned by root and writable by
+ * nobody else, since anyone able to replace it would become root
+ */
+static void check_helper(const char *hpath) {
+  char path[PATH_MAX + 1];
+  if (realpath(hpath, path) == NULL) {
+    fprintf(stderr, "Non-existent helper `%s'\n", hpath);
+    exit(EXIT_FAILURE);
+  }
+  for (;;) {
+    struct stat sb;
+    if (stat(path, &sb) == -1 || sb.st_uid != 0 ||
+        sb.st_mode & (S_IWGRP | S_IWOTH)) {
+      fprintf(stderr, "Unsafe helper `%s'\n", hpath);
+      exit(EXIT_FAILURE);
+    }
+    char *slash = strrchr(path, '/');
+    if (slash == NULL || slash == path) {
+      break;
+    }
+    *slash = '\0';
+  }
+}
+
+/**
+ * Start the helper through the escalation command with an empty
+ * environment, giving pipes for writing requests and reading answers
+ */
+static pid_t start_helper(const char *root, int *requests, int *answers) {
+  const char *escalate = getenv("STUFF_ESCALATE");
+  if (escalate == NULL) {
+    escalate = DEFAULT_ESCALATE;
+  }
+  char hpath[PATH_MAX + 1];
+  if (strspn(escalate, " \t") == strlen(escalate)) {
+    find_helper(hpath);
+  } else {
+    snprintf(hpath, PATH_MAX + 1, "%s", HELPER_PATH);
+    check_helper(hpath);
+  }
+  char *words = strdup(escalate);
+  if (words == NULL) {
+    fprintf(stderr, "Failure allocating escalation\n");
+    exit(EXIT_FAILURE);
+  }
+  char *args[MAX_ESCALATE_ARGS + 4];
+  int argc = 0;
+  char *saveptr = NULL;
+  for (char *word = strtok_r(words, " \t", &saveptr); word;
+       word = strtok_r(NULL, " \t", &saveptr)) {
+    if (argc == MAX_ESCALATE_ARGS) {
+      fprintf(stderr, "Invalid escalation `%s'\n", escalate);
+      exit(EXIT_FAILURE);
+    }
+    args[argc++] = word;
+  }
+  // Only blank values run the helper directly
+  if (argc > 0) {
+    args[argc++] = "--";
+  }
+  args[argc++] = hpath;
+  args[argc++] = (char *)root;
+  args[argc] = NULL;
+  int in[2], out[2];
+  if (pipe(in) == -1 || pipe(out) == -1) {
+    perror("Issue starting helper");
+    exit(EXIT_FAILURE);
+  }
+  // Flushing so buffered output isn't
+  // duplicated by the forked child
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("Issue starting helper");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    dup2(in[0], STDIN_FILENO);
+    dup2(out[1], STDOUT_FILENO);
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    // Nothing from our environment should
+    // reach a process running as root
+    char *env[] = {NULL};
+    execvpe(args[0], args, env);
+    perror("Issue running helper");
+    _exit(EXIT_FAILURE);
+  }
+  free(words);
+  close(in[0]);
+  close(out[1]);
+  *requests = in[1];
+  *answers = out[0];
+  return pid;
+}
+
+/**
+ * Hand every queued operation to the privileged helper in a
+ * single batch, printing each one done and exiting on failures
+ * where the journal stays held at the first queued entry
+ */
+void run_escalations(const char *root) {
+  if (gescalation_count == 0) {
+    return;
+  }
+  int requests, answers;
+  pid_t pid = start_helper(root, &requests, &answers);
+  // A helper exiting early is
+  // reported by its exit status
+  signal(SIGPIPE, SIG_IGN);
+  int errwrite = 0;
+  for (int i = 0; i < gescalation_count && !errwrite; i++) {
+    escalation_t *escalation = &gescalations[i];
+    if (escalation->unlink) {
+      errwrite = write_field(requests, "unlink");
+    } else {
+      errwrite = write_field(requests, "link") ||
+                 write_field(requests, escalation->target);
+    }
+    errwrite = errwrite || write_field(requests, escalation->lpath);
+  }
+  close(requests);
+  FILE *file = fdopen(answers, "r");
+  int failed = 0;
+  int i = 0;
+  char line[32];
+  while (file && i < gescalation_count && fgets(line, sizeof(line), file)) {
+    escalation_t *escalation = &gescalations[i++];
+    int err = atoi(line);
+    if (err == 0) {
+      if (escalation->message) {
+        printf("%s\n", escalation->message);
+      }
+      continue;
+    }
+    fprintf(stderr, "Issue escalating: %s\n", strerror(err));
+    fprintf(stderr, "Couldn't escalate `%s'\n", escalation->lpath);
+    failed = 1;
+  }
+  if (file) {
+    fclose(file);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (i < gescalation_count) {
+    fprintf(stderr, "Couldn't escalate `%s'\n", gescalations[i].lpath);
+    failed = 1;
+  }
+  if (failed || !WIFEXITED(status) || WEXITSTATUS(status)) {
+    exit(EXIT_FAILURE);
+  }
+  release_journal();
+}
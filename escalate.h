@@ -0,0 +1,12 @@
+#include <stddef.h>
+
+#ifndef ESCALATE_H
+#define ESCALATE_H
+
+void escalate_link(const char *target, const char *lpath, const char *message);
+
+void escalate_unlink(const char *lpath, const char *message);
+
+void run_escalations(const char *root);
+
+#endif
@@ -0,0 +1,919 @@
+#include "git.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Object types as stored in packs where
+// loose objects name them in their header
+#define OBJ_COMMIT 1
+#define OBJ_TREE 2
+#define OBJ_BLOB 3
+#define OBJ_TAG 4
+#define OBJ_OFS_DELTA 6
+#define OBJ_REF_DELTA 7
+
+// Modes for tree entries we treat differently
+#define MODE_TREE 0040000
+#define MODE_GITLINK 0160000
+
+// Bounds for following refs and ancestors
+static const int MAX_REF_DEPTH = 8;
+
+// Shortest abbreviated hash accepted like git
+static const size_t MIN_ABBREV_LENGTH = 4;
+
+// A pack index and its pack mapped into memory
+typedef struct {
+  unsigned char *idx;
+  size_t idxsize;
+  unsigned char *pack;
+  size_t packsize;
+} pack_t;
+
+// Packs are loaded once per run the first time an
+// object isn't found loose in the object directory,
+// which like shared refs lives in the common directory
+// of a worktree rather than the worktree's own gitdir
+static char ggitdir[PATH_MAX + 1];
+static char gcommondir[PATH_MAX + 1];
+static pack_t *gpacks = NULL;
+static int gpack_count = -1;
+
+// A single entry while reading a tree object
+typedef struct {
+  const char *name;
+  size_t namelen;
+  unsigned mode;
+  const unsigned char *sha;
+} tree_entry_t;
+
+static unsigned char *read_object(
+    const unsigned char *sha, int *type, size_t *size
+);
+
+/**
+ * Exit for any repository we can't make sense of
+ */
+static void fail(const char *message, const char *detail) {
+  fprintf(stderr, "%s `%s'\n", message, detail);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * Make a path within a directory into a buffer of
+ * PATH_MAX + 1, failing rather than truncating it
+ */
+static void make_path_in(
+    char *buf, const char *dir, const char *format, va_list args
+) {
+  int length = snprintf(buf, PATH_MAX + 1, "%s/", dir);
+  length += vsnprintf(&buf[length], PATH_MAX + 1 - length, format, args);
+  if (length > PATH_MAX) {
+    fail("Path too long in", dir);
+  }
+}
+
+/**
+ * Make a path within the common directory holding
+ * objects and shared refs, see make_path_in
+ */
+static void make_git_path(char *buf, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  make_path_in(buf, gcommondir, format, args);
+  va_end(args);
+}
+
+/**
+ * Make a path within the gitdir of the current
+ * worktree, see make_path_in
+ */
+static void make_worktree_path(char *buf, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  make_path_in(buf, ggitdir, format, args);
+  va_end(args);
+}
+
+/**
+ * Format a binary hash as hex into a buffer of 41
+ */
+static void format_sha(char *hex, const unsigned char *sha) {
+  for (int i = 0; i < GIT_SHA_LENGTH; i++) {
+    sprintf(&hex[i * 2], "%02x", sha[i]);
+  }
+}
+
+/**
+ * Parse 40 hex characters into a binary hash
+ * returning 1 when the string isn't a full hash
+ */
+static int parse_sha(const char *hex, unsigned char *sha) {
+  for (int i = 0; i < GIT_SHA_LENGTH; i++) {
+    unsigned value;
+    if (!isxdigit(hex[i * 2]) || !isxdigit(hex[i * 2 + 1]) ||
+        sscanf(&hex[i * 2], "%2x", &value) != 1) {
+      return 1;
+    }
+    sha[i] = (unsigned char)value;
+  }
+  return 0;
+}
+
+/**
+ * Map a whole file read-only into memory
+ */
+static unsigned char *map_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) == -1 || sb.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  void *data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  *size = sb.st_size;
+  return (unsigned char *)data;
+}
+
+/**
+ * Inflate zlib data into a buffer growing as needed, where a
+ * known size avoids growing at all. Allocates memory for the
+ * returned pointer which needs to be freed by the caller.
+ */
+static unsigned char *inflate_data(
+    const unsigned char *in, size_t insize, size_t expected, size_t *outsize
+) {
+  size_t capacity = expected ? expected + 1 : 4096;
+  unsigned char *out = (unsigned char *)malloc(capacity);
+  z_stream stream = {0};
+  if (out == NULL || inflateInit(&stream) != Z_OK) {
+    fail("Failure inflating", ggitdir);
+  }
+  stream.next_in = (unsigned char *)in;
+  stream.avail_in = insize;
+  int status = Z_OK;
+  while (status != Z_STREAM_END) {
+    if (stream.total_out == capacity) {
+      capacity *= 2;
+      out = (unsigned char *)realloc(out, capacity);
+      if (out == NULL) {
+        fail("Failure inflating", ggitdir);
+      }
+    }
+    stream.next_out = out + stream.total_out;
+    stream.avail_out = capacity - stream.total_out;
+    status = inflate(&stream, Z_NO_FLUSH);
+    if (status != Z_OK && status != Z_STREAM_END) {
+      fail("Corrupt object in", ggitdir);
+    }
+  }
+  *outsize = stream.total_out;
+  inflateEnd(&stream);
+  return out;
+}
+
+/**
+ * Map every pack along with its index which
+ * only supports the current version two indexes
+ */
+static void load_packs(void) {
+  gpack_count = 0;
+  char dpath[PATH_MAX + 1];
+  make_git_path(dpath, "objects/pack");
+  DIR *dir = opendir(dpath);
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent *dent;
+  while ((dent = readdir(dir)) != NULL) {
+    size_t length = strlen(dent->d_name);
+    if (length < 4 || strcmp(&dent->d_name[length - 4], ".idx")) {
+      continue;
+    }
+    char ipath[PATH_MAX + 1];
+    make_git_path(ipath, "objects/pack/%s", dent->d_name);
+    char ppath[PATH_MAX + 1];
+    make_git_path(
+        ppath, "objects/pack/%.*s.pack", (int)length - 4, dent->d_name
+    );
+    pack_t pack;
+    pack.idx = map_file(ipath, &pack.idxsize);
+    pack.pack = map_file(ppath, &pack.packsize);
+    if (pack.idx == NULL || pack.pack == NULL || pack.idxsize < 8 + 1024 ||
+        memcmp(pack.idx, "\377tOc\0\0\0\2", 8)) {
+      fail("Unsupported pack", ipath);
+    }
+    gpacks = (pack_t *)realloc(gpacks, (gpack_count + 1) * sizeof(pack_t));
+    if (gpacks == NULL) {
+      fail("Failure allocating packs in", ggitdir);
+    }
+    gpacks[gpack_count++] = pack;
+  }
+  closedir(dir);
+}
+
+/**
+ * Read a big-endian 32-bit integer
+ */
+static uint32_t read_uint32(const unsigned char *pos) {
+  return (uint32_t)pos[0] << 24 | (uint32_t)pos[1] << 16 |
+         (uint32_t)pos[2] << 8 | (uint32_t)pos[3];
+}
+
+/**
+ * Find an object within a pack index using the fanout table to
+ * narrow a binary search. Returns 1 when the object isn't found.
+ */
+static int find_in_pack(
+    const pack_t *pack, const unsigned char *sha, uint64_t *offset
+) {
+  const unsigned char *fanout = pack->idx + 8;
+  uint32_t count = read_uint32(fanout + 255 * 4);
+  uint32_t lo = sha[0] ? read_uint32(fanout + (sha[0] - 1) * 4) : 0;
+  uint32_t hi = read_uint32(fanout + sha[0] * 4);
+  const unsigned char *shas = fanout + 1024;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    int cmp = memcmp(sha, shas + (size_t)mid * GIT_SHA_LENGTH, GIT_SHA_LENGTH);
+    if (cmp == 0) {
+      const unsigned char *offsets = shas + (size_t)count * 24;
+      uint32_t small = read_uint32(offsets + (size_t)mid * 4);
+      if (!(small & 0x80000000)) {
+        *offset = small;
+        return 0;
+      }
+      // Large offsets live in a table of their own
+      const unsigned char *large = offsets + (size_t)count * 4 +
+                                   (size_t)(small & 0x7fffffff) * 8;
+      *offset = (uint64_t)read_uint32(large) << 32 | read_uint32(large + 4);
+      return 0;
+    }
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Read a variable length size used by deltas
+ */
+static size_t read_delta_size(
+    const unsigned char **pos, const unsigned char *end
+) {
+  size_t size = 0;
+  int shift = 0;
+  unsigned char c;
+  do {
+    if (*pos >= end) {
+      fail("Corrupt delta in", ggitdir);
+    }
+    c = *(*pos)++;
+    size |= (size_t)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return size;
+}
+
+/**
+ * Rebuild an object from its base and a delta made of copy and
+ * insert instructions. Allocates memory for the returned pointer
+ * which needs to be freed by the caller.
+ */
+static unsigned char *apply_delta(
+    const unsigned char *base, size_t basesize, const unsigned char *delta,
+    size_t deltasize, size_t *size
+) {
+  const unsigned char *pos = delta;
+  const unsigned char *end = delta + deltasize;
+  if (read_delta_size(&pos, end) != basesize) {
+    fail("Corrupt delta in", ggitdir);
+  }
+  *size = read_delta_size(&pos, end);
+  unsigned char *out = (unsigned char *)malloc(*size + 1);
+  if (out == NULL) {
+    fail("Failure allocating object in", ggitdir);
+  }
+  size_t written = 0;
+  while (pos < end) {
+    unsigned char op = *pos++;
+    if (op & 0x80) {
+      size_t offset = 0, length = 0;
+      for (int i = 0; i < 4; i++) {
+        if (op & (1 << i)) {
+          offset |= (size_t)*pos++ << (i * 8);
+        }
+      }
+      for (int i = 0; i < 3; i++) {
+        if (op & (0x10 << i)) {
+          length |= (size_t)*pos++ << (i * 8);
+        }
+      }
+      if (length == 0) {
+        length = 0x10000;
+      }
+      if (offset + length > basesize || written + length > *size) {
+        fail("Corrupt delta in", ggitdir);
+      }
+      memcpy(out + written, base + offset, length);
+      written += length;
+    } else if (op) {
+      if (pos + op > end || written + op > *size) {
+        fail("Corrupt delta in", ggitdir);
+      }
+      memcpy(out + written, pos, op);
+      written += op;
+      pos += op;
+    } else {
+      fail("Corrupt delta in", ggitdir);
+    }
+  }
+  if (written != *size) {
+    fail("Corrupt delta in", ggitdir);
+  }
+  return out;
+}
+
+/**
+ * Read an object at an offset in a pack, resolving deltas against
+ * their base. Allocates memory for the returned pointer which
+ * needs to be freed by the caller.
+ */
+static unsigned char *read_pack_object(
+    const pack_t *pack, uint64_t offset, int *type, size_t *size
+) {
+  if (offset >= pack->packsize) {
+    fail("Corrupt pack in", ggitdir);
+  }
+  const unsigned char *pos = pack->pack + offset;
+  const unsigned char *end = pack->pack + pack->packsize;
+  unsigned char c = *pos++;
+  int kind = (c >> 4) & 7;
+  size_t expected = c & 15;
+  int shift = 4;
+  while (c & 0x80 && pos < end) {
+    c = *pos++;
+    expected |= (size_t)(c & 0x7f) << shift;
+    shift += 7;
+  }
+  unsigned char *base = NULL;
+  size_t basesize = 0;
+  if (kind == OBJ_OFS_DELTA) {
+    c = *pos++;
+    uint64_t distance = c & 0x7f;
+    while (c & 0x80 && pos < end) {
+      c = *pos++;
+      distance = ((distance + 1) << 7) | (c & 0x7f);
+    }
+    if (distance > offset) {
+      fail("Corrupt pack in", ggitdir);
+    }
+    base = read_pack_object(pack, offset - distance, type, &basesize);
+  } else if (kind == OBJ_REF_DELTA) {
+    if (pos + GIT_SHA_LENGTH > end) {
+      fail("Corrupt pack in", ggitdir);
+    }
+    base = read_object(pos, type, &basesize);
+    pos += GIT_SHA_LENGTH;
+  }
+  size_t datasize;
+  unsigned char *data = inflate_data(pos, end - pos, expected, &datasize);
+  if (base == NULL) {
+    *type = kind;
+    *size = datasize;
+    return data;
+  }
+  unsigned char *object = apply_delta(base, basesize, data, datasize, size);
+  free(base);
+  free(data);
+  return object;
+}
+
+/**
+ * Read a loose object which names its type in a header
+ * before the content. Returns NULL for missing objects.
+ */
+static unsigned char *read_loose_object(
+    const unsigned char *sha, int *type, size_t *size
+) {
+  char hex[GIT_SHA_LENGTH * 2 + 1];
+  format_sha(hex, sha);
+  char opath[PATH_MAX + 1];
+  make_git_path(opath, "objects/%.2s/%s", hex, &hex[2]);
+  size_t filesize;
+  unsigned char *file = map_file(opath, &filesize);
+  if (file == NULL) {
+    return NULL;
+  }
+  size_t rawsize;
+  unsigned char *raw = inflate_data(file, filesize, 0, &rawsize);
+  munmap(file, filesize);
+  unsigned char *nul = memchr(raw, '\0', rawsize);
+  if (nul == NULL) {
+    fail("Corrupt object", hex);
+  }
+  const struct {
+    int val;
+    const char *str;
+  } map[] = {
+      {OBJ_COMMIT, "commit "},
+      {OBJ_TREE, "tree "},
+      {OBJ_BLOB, "blob "},
+      {OBJ_TAG, "tag "}
+  };
+  *type = 0;
+  for (size_t i = 0; i < sizeof(map) / sizeof(map[0]); i++) {
+    if (!strncmp((char *)raw, map[i].str, strlen(map[i].str))) {
+      *type = map[i].val;
+    }
+  }
+  *size = rawsize - (nul + 1 - raw);
+  memmove(raw, nul + 1, *size);
+  return raw;
+}
+
+/**
+ * Read any object whether loose or packed, failing for missing
+ * objects. Allocates memory for the returned pointer which needs
+ * to be freed by the caller.
+ */
+static unsigned char *read_object(
+    const unsigned char *sha, int *type, size_t *size
+) {
+  unsigned char *object = read_loose_object(sha, type, size);
+  if (object) {
+    return object;
+  }
+  if (gpack_count == -1) {
+    load_packs();
+  }
+  for (int i = 0; i < gpack_count; i++) {
+    uint64_t offset;
+    if (!find_in_pack(&gpacks[i], sha, &offset)) {
+      return read_pack_object(&gpacks[i], offset, type, size);
+    }
+  }
+  char hex[GIT_SHA_LENGTH * 2 + 1];
+  format_sha(hex, sha);
+  fail("Missing object", hex);
+  return NULL;
+}
+
+/**
+ * Find a header line like "tree <hash>" in a commit or tag,
+ * taking the nth occurrence. Returns 1 when there's no such line.
+ */
+static int find_header(
+    const unsigned char *object, size_t size, const char *name, int nth,
+    unsigned char *sha
+) {
+  const char *pos = (const char *)object;
+  const char *end = pos + size;
+  size_t length = strlen(name);
+  // Headers end at the first empty line
+  while (pos < end && *pos != '\n') {
+    const char *eol = memchr(pos, '\n', end - pos);
+    if (eol == NULL) {
+      eol = end;
+    }
+    if ((size_t)(eol - pos) > length && !strncmp(pos, name, length) &&
+        pos[length] == ' ' && nth-- == 0) {
+      return parse_sha(&pos[length + 1], sha);
+    }
+    pos = eol + 1;
+  }
+  return 1;
+}
+
+/**
+ * Peel tags until reaching a commit, failing for anything else
+ */
+static void peel_commit(unsigned char *sha, const char *rev) {
+  for (int depth = 0; depth < MAX_REF_DEPTH; depth++) {
+    int type;
+    size_t size;
+    unsigned char *object = read_object(sha, &type, &size);
+    int err = type == OBJ_TAG ? find_header(object, size, "object", 0, sha) : 0;
+    free(object);
+    if (type == OBJ_COMMIT) {
+      return;
+    }
+    if (type != OBJ_TAG || err) {
+      break;
+    }
+  }
+  fail("Not a commit", rev);
+}
+
+/**
+ * Read the hash a ref points at following symbolic refs and
+ * falling back to packed refs, where refs like HEAD belong to
+ * the worktree and others are shared. Returns 1 for missing refs.
+ */
+static int read_ref(const char *name, unsigned char *sha, int depth) {
+  if (depth > MAX_REF_DEPTH) {
+    return 1;
+  }
+  char rpath[PATH_MAX + 1];
+  make_worktree_path(rpath, "%s", name);
+  FILE *file = fopen(rpath, "r");
+  if (file == NULL && strcmp(ggitdir, gcommondir)) {
+    make_git_path(rpath, "%s", name);
+    file = fopen(rpath, "r");
+  }
+  if (file) {
+    char line[PATH_MAX + 1] = {0};
+    char *read = fgets(line, sizeof(line), file);
+    fclose(file);
+    if (read == NULL) {
+      return 1;
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+    if (!strncmp(line, "ref: ", 5)) {
+      return read_ref(&line[5], sha, depth + 1);
+    }
+    return parse_sha(line, sha);
+  }
+  make_git_path(rpath, "packed-refs");
+  file = fopen(rpath, "r");
+  if (file == NULL) {
+    return 1;
+  }
+  char line[PATH_MAX + 1];
+  int err = 1;
+  while (err && fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (strlen(line) > GIT_SHA_LENGTH * 2 + 1 &&
+        !strcmp(&line[GIT_SHA_LENGTH * 2 + 1], name)) {
+      err = parse_sha(line, sha);
+    }
+  }
+  fclose(file);
+  return err;
+}
+
+/**
+ * Record an object matching an abbreviated hash, counting
+ * distinct matches since objects can be both loose and packed
+ */
+static void add_abbrev_match(
+    const unsigned char *found, unsigned char *sha, int *matches
+) {
+  if (*matches == 0 || memcmp(found, sha, GIT_SHA_LENGTH)) {
+    memcpy(sha, found, GIT_SHA_LENGTH);
+    (*matches)++;
+  }
+}
+
+/**
+ * Find the object an abbreviated hash names by listing its loose
+ * directory and the fanout bucket of every pack index. Gives the
+ * number of distinct objects found where only one is usable.
+ */
+static int find_abbrev(const char *abbrev, unsigned char *sha) {
+  size_t length = strlen(abbrev);
+  int matches = 0;
+  unsigned char found[GIT_SHA_LENGTH];
+  char hex[GIT_SHA_LENGTH * 2 + 1];
+  char dpath[PATH_MAX + 1];
+  make_git_path(dpath, "objects/%.2s", abbrev);
+  DIR *dir = opendir(dpath);
+  if (dir != NULL) {
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL) {
+      if (strlen(dent->d_name) != GIT_SHA_LENGTH * 2 - 2) {
+        continue;
+      }
+      memcpy(hex, abbrev, 2);
+      memcpy(&hex[2], dent->d_name, GIT_SHA_LENGTH * 2 - 1);
+      if (!strncmp(hex, abbrev, length) && !parse_sha(hex, found)) {
+        add_abbrev_match(found, sha, &matches);
+      }
+    }
+    closedir(dir);
+  }
+  if (gpack_count == -1) {
+    load_packs();
+  }
+  unsigned first;
+  sscanf(abbrev, "%2x", &first);
+  for (int i = 0; i < gpack_count; i++) {
+    const unsigned char *fanout = gpacks[i].idx + 8;
+    uint32_t lo = first ? read_uint32(fanout + (first - 1) * 4) : 0;
+    uint32_t hi = read_uint32(fanout + first * 4);
+    const unsigned char *shas = fanout + 1024;
+    for (uint32_t j = lo; j < hi; j++) {
+      format_sha(hex, shas + (size_t)j * GIT_SHA_LENGTH);
+      if (!strncmp(hex, abbrev, length)) {
+        add_abbrev_match(shas + (size_t)j * GIT_SHA_LENGTH, sha, &matches);
+      }
+    }
+  }
+  return matches;
+}
+
+/**
+ * Resolve a revision which is either a full hash, a ref searched
+ * for the same way git does, or a unique abbreviated hash, followed
+ * by any number of "^" or "~<n>" suffixes walking first parents
+ */
+static void resolve_revision(const char *rev, unsigned char *sha) {
+  char name[PATH_MAX + 1];
+  snprintf(name, PATH_MAX + 1, "%s", rev);
+  char *suffix = &name[strcspn(name, "^~")];
+  char suffixes[PATH_MAX + 1];
+  snprintf(suffixes, PATH_MAX + 1, "%s", suffix);
+  *suffix = '\0';
+  const char *rules[] = {
+      "%s", "refs/%s", "refs/tags/%s", "refs/heads/%s", "refs/remotes/%s",
+      "refs/remotes/%s/HEAD"
+  };
+  int err = strlen(name) != GIT_SHA_LENGTH * 2 || parse_sha(name, sha);
+  for (size_t i = 0; err && i < sizeof(rules) / sizeof(rules[0]); i++) {
+    char ref[PATH_MAX + 1];
+    snprintf(ref, PATH_MAX + 1, rules[i], name);
+    err = read_ref(ref, sha, 0);
+  }
+  // Abbreviated hashes come last
+  // since refs can look like hex
+  size_t length = strlen(name);
+  if (err && length >= MIN_ABBREV_LENGTH && length < GIT_SHA_LENGTH * 2 &&
+      strspn(name, "0123456789abcdef") == length) {
+    int matches = find_abbrev(name, sha);
+    if (matches > 1) {
+      fail("Ambiguous revision", rev);
+    }
+    err = matches == 0;
+  }
+  if (err) {
+    fail("Unknown revision", rev);
+  }
+  peel_commit(sha, rev);
+  for (const char *pos = suffixes; *pos;) {
+    char op = *pos++;
+    long count = 1;
+    if (isdigit(*pos)) {
+      count = strtol(pos, (char **)&pos, 10);
+    }
+    // Only first parents are supported
+    if (op == '^' && count > 1) {
+      fail("Unsupported revision", rev);
+    }
+    if (op == '^' && count == 0) {
+      continue;
+    }
+    while (count-- > 0) {
+      int type;
+      size_t size;
+      unsigned char *object = read_object(sha, &type, &size);
+      int errparent = find_header(object, size, "parent", 0, sha);
+      free(object);
+      if (errparent) {
+        fail("No parent for revision", rev);
+      }
+    }
+  }
+}
+
+/**
+ * Read the root tree for a commit
+ */
+static void read_commit_tree(const unsigned char *commit, unsigned char *tree) {
+  int type;
+  size_t size;
+  unsigned char *object = read_object(commit, &type, &size);
+  int err = type != OBJ_COMMIT || find_header(object, size, "tree", 0, tree);
+  free(object);
+  if (err) {
+    char hex[GIT_SHA_LENGTH * 2 + 1];
+    format_sha(hex, commit);
+    fail("Corrupt commit", hex);
+  }
+}
+
+/**
+ * Parse the next entry in a tree object giving NULL at the end
+ */
+static const unsigned char *next_tree_entry(
+    const unsigned char *pos, const unsigned char *end, tree_entry_t *entry
+) {
+  if (pos >= end) {
+    return NULL;
+  }
+  unsigned mode = 0;
+  while (pos < end && *pos >= '0' && *pos <= '7') {
+    mode = (mode << 3) | (*pos++ - '0');
+  }
+  const unsigned char *nul = pos < end ? memchr(pos, '\0', end - pos) : NULL;
+  if (nul == NULL || *pos != ' ' || nul + 1 + GIT_SHA_LENGTH > end) {
+    fail("Corrupt tree in", ggitdir);
+  }
+  entry->mode = mode;
+  entry->name = (const char *)pos + 1;
+  entry->namelen = nul - (pos + 1);
+  entry->sha = nul + 1;
+  return nul + 1 + GIT_SHA_LENGTH;
+}
+
+/**
+ * Order tree entries the way git sorts them
+ * where directories compare as if ending in "/"
+ */
+static int compare_tree_entries(const tree_entry_t *a, const tree_entry_t *b) {
+  size_t length = a->namelen < b->namelen ? a->namelen : b->namelen;
+  int cmp = memcmp(a->name, b->name, length);
+  if (cmp) {
+    return cmp;
+  }
+  unsigned char ca = a->namelen > length ? a->name[length]
+                     : a->mode == MODE_TREE ? '/'
+                                            : '\0';
+  unsigned char cb = b->namelen > length ? b->name[length]
+                     : b->mode == MODE_TREE ? '/'
+                                            : '\0';
+  return ca - cb;
+}
+
+static void diff_trees(
+    const unsigned char *from, const unsigned char *to, const char *prefix,
+    git_change_t treat
+);
+
+/**
+ * Report an entry only found on one side, including everything
+ * beneath it for directories after the directory itself
+ */
+static void report_entry(
+    const tree_entry_t *entry, const char *prefix, change_t change,
+    git_change_t treat
+) {
+  if (entry->mode == MODE_GITLINK) {
+    // Submodules have no objects here
+    return;
+  }
+  char rpath[PATH_MAX + 1];
+  snprintf(
+      rpath, PATH_MAX + 1, "%s%s%.*s", prefix, *prefix ? "/" : "",
+      (int)entry->namelen, entry->name
+  );
+  int isdir = entry->mode == MODE_TREE;
+  treat(rpath, change, entry->sha, isdir);
+  if (isdir) {
+    diff_trees(
+        change == REMOVED ? entry->sha : NULL,
+        change == ADDED ? entry->sha : NULL, rpath, treat
+    );
+  }
+}
+
+/**
+ * Diff two trees by merging their sorted entries, skipping any
+ * subtree whose hash hasn't changed without reading it at all
+ */
+static void diff_trees(
+    const unsigned char *from, const unsigned char *to, const char *prefix,
+    git_change_t treat
+) {
+  int type;
+  size_t fsize = 0, tsize = 0;
+  unsigned char *fobject = from ? read_object(from, &type, &fsize) : NULL;
+  unsigned char *tobject = to ? read_object(to, &type, &tsize) : NULL;
+  const unsigned char *fend = fobject + fsize;
+  const unsigned char *tend = tobject + tsize;
+  tree_entry_t fentry, tentry;
+  const unsigned char *fpos = next_tree_entry(fobject, fend, &fentry);
+  const unsigned char *tpos = next_tree_entry(tobject, tend, &tentry);
+  while (fpos || tpos) {
+    int cmp = !fpos ? 1 : !tpos ? -1 : compare_tree_entries(&fentry, &tentry);
+    if (cmp < 0) {
+      report_entry(&fentry, prefix, REMOVED, treat);
+      fpos = next_tree_entry(fpos, fend, &fentry);
+      continue;
+    }
+    if (cmp > 0) {
+      report_entry(&tentry, prefix, ADDED, treat);
+      tpos = next_tree_entry(tpos, tend, &tentry);
+      continue;
+    }
+    int fisdir = fentry.mode == MODE_TREE;
+    int tisdir = tentry.mode == MODE_TREE;
+    if (fisdir && tisdir &&
+        memcmp(fentry.sha, tentry.sha, GIT_SHA_LENGTH)) {
+      char rpath[PATH_MAX + 1];
+      snprintf(
+          rpath, PATH_MAX + 1, "%s%s%.*s", prefix, *prefix ? "/" : "",
+          (int)fentry.namelen, fentry.name
+      );
+      diff_trees(fentry.sha, tentry.sha, rpath, treat);
+    } else if (fisdir != tisdir) {
+      report_entry(&fentry, prefix, REMOVED, treat);
+      report_entry(&tentry, prefix, ADDED, treat);
+    }
+    // Changed file contents keep
+    // existing links valid as is
+    fpos = next_tree_entry(fpos, fend, &fentry);
+    tpos = next_tree_entry(tpos, tend, &tentry);
+  }
+  free(fobject);
+  free(tobject);
+}
+
+/**
+ * Read the first line of a file into a buffer of PATH_MAX + 1
+ * without its line ending. Returns 1 when it can't be read.
+ */
+static int read_line(const char *path, char *line) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return 1;
+  }
+  char *read = fgets(line, PATH_MAX + 1, file);
+  fclose(file);
+  if (read == NULL) {
+    return 1;
+  }
+  line[strcspn(line, "\r\n")] = '\0';
+  return 0;
+}
+
+/**
+ * Resolve a path read from a file within the directory
+ * holding that file unless the path is already absolute
+ */
+static void resolve_beside(char *buf, const char *fpath, const char *path) {
+  const char *slash = strrchr(fpath, '/');
+  int length;
+  if (*path == '/' || slash == NULL) {
+    length = snprintf(buf, PATH_MAX + 1, "%s", path);
+  } else {
+    int dirlen = (int)(slash - fpath);
+    length = snprintf(buf, PATH_MAX + 1, "%.*s/%s", dirlen, fpath, path);
+  }
+  if (length > PATH_MAX) {
+    fail("Path too long in", fpath);
+  }
+}
+
+/**
+ * Find the repository directory where worktrees and submodules
+ * have a file pointing at their gitdir instead, and the common
+ * directory a worktree's gitdir names for objects and shared refs
+ */
+static void resolve_gitdir(const char *gitdir) {
+  snprintf(ggitdir, PATH_MAX + 1, "%s", gitdir);
+  struct stat sb;
+  if (stat(gitdir, &sb) == -1) {
+    fail("Non-existent repository", gitdir);
+  }
+  char line[PATH_MAX + 1];
+  if (!S_ISDIR(sb.st_mode)) {
+    if (read_line(gitdir, line) || strncmp(line, "gitdir: ", 8)) {
+      fail("Invalid repository", gitdir);
+    }
+    resolve_beside(ggitdir, gitdir, &line[8]);
+  }
+  snprintf(gcommondir, PATH_MAX + 1, "%s", ggitdir);
+  char cpath[PATH_MAX + 1];
+  make_worktree_path(cpath, "commondir");
+  if (!read_line(cpath, line)) {
+    resolve_beside(gcommondir, cpath, line);
+  }
+}
+
+/**
+ * Report paths added or removed between two revisions reading
+ * objects straight from the repository without running git
+ */
+void diff_revisions(
+    const char *gitdir, const char *from, const char *to, git_change_t treat
+) {
+  resolve_gitdir(gitdir);
+  unsigned char fcommit[GIT_SHA_LENGTH], tcommit[GIT_SHA_LENGTH];
+  resolve_revision(from, fcommit);
+  resolve_revision(to, tcommit);
+  unsigned char ftree[GIT_SHA_LENGTH], ttree[GIT_SHA_LENGTH];
+  read_commit_tree(fcommit, ftree);
+  read_commit_tree(tcommit, ttree);
+  if (memcmp(ftree, ttree, GIT_SHA_LENGTH)) {
+    diff_trees(ftree, ttree, "", treat);
+  }
+}
@@ -0,0 +1,21 @@
+#include <stddef.h>
+
+#ifndef GIT_H
+#define GIT_H
+
+#define GIT_SHA_LENGTH 20
+
+typedef enum { ADDED, REMOVED } change_t;
+
+// Handles a path changed between two commits given the path
+// relative to the repository, how it changed, its object hash,
+// and whether it's a directory
+typedef void (*git_change_t)(
+    const char *rpath, change_t change, const unsigned char *sha, int isdir
+);
+
+void diff_revisions(
+    const char *gitdir, const char *from, const char *to, git_change_t treat
+);
+
+#endif
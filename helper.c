@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Minimal helper stuff runs with privileges for the links it
+// couldn't create or remove itself. Requests are read from stdin
+// as NUL separated fields, either "link", target, and path or
+// "unlink" and path, and each is answered in order with a line
+// holding zero or the error number on stdout.
+
+// A single request read before any is run
+typedef struct {
+  int unlink;
+  char *target;
+  char *lpath;
+} request_t;
+
+// Every path must be beneath the real root, which comes
+// from the caller so it only guards against mistakes
+static char groot[PATH_MAX + 1];
+
+/**
+ * Read the next NUL terminated field giving NULL at the end.
+ * Allocates memory for the returned pointer which needs to be
+ * freed by the caller.
+ */
+static char *read_field(void) {
+  char *field = NULL;
+  size_t size = 0;
+  ssize_t length = getdelim(&field, &size, '\0', stdin);
+  if (length == -1) {
+    free(field);
+    return NULL;
+  }
+  if (length > PATH_MAX || field[length - 1] != '\0') {
+    fprintf(stderr, "Invalid request field\n");
+    exit(EXIT_FAILURE);
+  }
+  return field;
+}
+
+/**
+ * Read every request before running any so stuff never blocks
+ * writing requests while we're blocked writing answers
+ */
+static request_t *read_requests(int *count) {
+  request_t *requests = NULL;
+  *count = 0;
+  char *kind;
+  while ((kind = read_field()) != NULL) {
+    size_t size = (*count + 1) * sizeof(request_t);
+    requests = (request_t *)realloc(requests, size);
+    if (requests == NULL) {
+      fprintf(stderr, "Failure allocating requests\n");
+      exit(EXIT_FAILURE);
+    }
+    request_t *request = &requests[(*count)++];
+    request->unlink = !strcmp(kind, "unlink");
+    if (!request->unlink && strcmp(kind, "link")) {
+      fprintf(stderr, "Invalid request `%s'\n", kind);
+      exit(EXIT_FAILURE);
+    }
+    free(kind);
+    request->target = request->unlink ? NULL : read_field();
+    request->lpath = read_field();
+    if ((!request->unlink && request->target == NULL) ||
+        request->lpath == NULL) {
+      fprintf(stderr, "Truncated request\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return requests;
+}
+
+/**
+ * Check whether a real path is the root or beneath it
+ */
+static int is_beneath_root(const char *path) {
+  size_t length = strlen(groot);
+  if (!strcmp(groot, "/")) {
+    return 1;
+  }
+  return !strncmp(path, groot, length) &&
+         (path[length] == '/' || path[length] == '\0');
+}
+
+/**
+ * Open the directory holding a link path once it's confirmed
+ * to really be beneath the root, checking the opened directory
+ * itself so nothing can be swapped in after checking. Returns
+ * -1 with errno set when the path isn't allowed.
+ */
+static int open_parent(const char *lpath, const char **name) {
+  const char *slash = strrchr(lpath, '/');
+  if (lpath[0] != '/' || slash == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+  *name = slash + 1;
+  if (**name == '\0' || !strcmp(*name, ".") || !strcmp(*name, "..")) {
+    errno = EPERM;
+    return -1;
+  }
+  char dpath[PATH_MAX + 1];
+  snprintf(dpath, PATH_MAX + 1, "%.*s", (int)(slash - lpath), lpath);
+  int fd = open(*dpath ? dpath : "/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  char fdpath[32];
+  snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", fd);
+  char opened[PATH_MAX + 1];
+  ssize_t length = readlink(fdpath, opened, PATH_MAX);
+  if (length == -1) {
+    close(fd);
+    return -1;
+  }
+  opened[length] = '\0';
+  if (!is_beneath_root(opened)) {
+    close(fd);
+    errno = EPERM;
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Run a single request where only links are ever
+ * removed, giving zero or the error number
+ */
+static int run_request(const request_t *request) {
+  const char *name;
+  int fd = open_parent(request->lpath, &name);
+  if (fd == -1) {
+    return errno;
+  }
+  int err = 0;
+  if (request->unlink) {
+    struct stat sb;
+    if (fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) == -1) {
+      err = errno;
+    } else if (!S_ISLNK(sb.st_mode)) {
+      err = EPERM;
+    } else if (unlinkat(fd, name, 0) == -1) {
+      err = errno;
+    }
+  } else if (symlinkat(request->target, fd, name) == -1) {
+    err = errno;
+  }
+  close(fd);
+  return err;
+}
+
+// Entry point for stuff-helper
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <root>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (realpath(argv[1], groot) == NULL) {
+    fprintf(stderr, "Non-existent root `%s'\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  int count;
+  request_t *requests = read_requests(&count);
+  for (int i = 0; i < count; i++) {
+    printf("%d\n", run_request(&requests[i]));
+  }
+  return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
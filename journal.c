@@ -0,0 +1,264 @@
+#include "journal.h"
+#include "options/hidden.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Kept in the project root next to what it tracks
+// and removed again once a run finishes
+const char *JOURNAL_FILE = ".stuff-journal";
+
+// Entries completed between checkpoints where
+// anything after the last one is redone on resume
+static const long JOURNAL_INTERVAL = 64;
+
+// Describes the run so a resume can't continue a different one
+static char *gheader = NULL;
+static size_t gheader_length = 0;
+static int gjournal = -1;
+static int gresuming = 0;
+static int gfinished = 0;
+// Set when another run's journal is in the way
+// so this run neither checkpoints nor removes it
+static int gforeign = 0;
+// Entries seen so far this run, entries the resumed run
+// already completed, and entries written to the journal
+static long gentries = 0;
+static long gcompleted = 0;
+static long gresumed = 0;
+static long gcheckpointed = 0;
+// Entries from the first one handed to the privileged
+// helper onwards aren't done until the helper confirms
+static long gheld = LONG_MAX;
+// Paths of the last entry completed, the last one completed
+// before any held, and the last one the resumed run completed
+// so resuming can tell when entries have shifted since
+static char glast[PATH_MAX + 1];
+static char gheld_last[PATH_MAX + 1];
+static char gresumed_last[PATH_MAX + 1];
+
+/**
+ * Append a line describing the run to the header
+ */
+static void append_header(const char *key, const char *value) {
+  size_t length = strlen(key) + 1 + strlen(value) + 1;
+  gheader = (char *)realloc(gheader, gheader_length + length + 1);
+  if (gheader == NULL) {
+    fprintf(stderr, "Failure allocating journal\n");
+    exit(EXIT_FAILURE);
+  }
+  sprintf(&gheader[gheader_length], "%s %s\n", key, value);
+  gheader_length += length;
+}
+
+/**
+ * Write a whole buffer to the journal, giving up quietly
+ * since a missing checkpoint only means redoing work
+ */
+static void write_journal(const char *buf, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(gjournal, buf, length);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("Issue writing journal");
+      return;
+    }
+    buf += written;
+    length -= written;
+  }
+}
+
+/**
+ * Record every entry completed so far up to any held by the
+ * privileged helper, creating the journal with its header the
+ * first time so short runs never touch it
+ */
+static void write_checkpoint(void) {
+  long done = gcompleted < gheld ? gcompleted : gheld;
+  if (gforeign || done <= gcheckpointed) {
+    return;
+  }
+  const char *last = done == gcompleted ? glast : gheld_last;
+  if (gjournal == -1) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    flags |= gresuming ? O_APPEND : O_TRUNC;
+    gjournal = open(JOURNAL_FILE, flags, 0644);
+    if (gjournal == -1) {
+      perror("Issue opening journal");
+      return;
+    }
+    if (!gresuming) {
+      write_journal(gheader, gheader_length);
+    }
+  }
+  char line[PATH_MAX + 32];
+  int length = snprintf(line, sizeof(line), "done %ld %s\n", done, last);
+  write_journal(line, length);
+  gcheckpointed = done;
+}
+
+/**
+ * Checkpoint whatever was completed when exiting
+ * early on the first error partway through a run
+ */
+static void checkpoint_on_exit(void) {
+  if (!gfinished) {
+    write_checkpoint();
+  }
+}
+
+/**
+ * Read how many entries a previous run completed and the last
+ * of them. Returns -1 without a journal, 0 when the journal
+ * belongs to another run, and 1 when it belongs to this one.
+ */
+static int read_journal(void) {
+  FILE *file = fopen(JOURNAL_FILE, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char *line = NULL;
+  size_t size = 0;
+  size_t offset = 0;
+  int matches = 1;
+  while (getline(&line, &size, file) != -1) {
+    long done;
+    int start = 0;
+    if (sscanf(line, "done %ld %n", &done, &start) == 1 && start) {
+      line[strcspn(line, "\n")] = '\0';
+      snprintf(gresumed_last, PATH_MAX + 1, "%s", &line[start]);
+      gresumed = done;
+      continue;
+    }
+    size_t length = strlen(line);
+    if (offset + length > gheader_length ||
+        strncmp(&gheader[offset], line, length)) {
+      matches = 0;
+    }
+    offset += length;
+  }
+  free(line);
+  fclose(file);
+  return matches && offset == gheader_length;
+}
+
+/**
+ * Start journaling a bulk run of a command over some paths,
+ * continuing from the last checkpoint when resuming. A journal
+ * left by another run is never touched so it can still resume.
+ */
+void start_journal(const char *command, char **paths, int count, int resume) {
+  append_header("command", command);
+  append_header("root", ghidden_opts.rvalue);
+  for (int i = 0; i < ghidden_opts.lcount; i++) {
+    append_header("layer", ghidden_opts.lvalues[i]);
+  }
+  for (int i = 0; i < count; i++) {
+    append_header("path", paths[i]);
+  }
+  gresuming = resume;
+  int journal = read_journal();
+  if (resume && journal == -1) {
+    fprintf(stderr, "Non-existent journal `%s'\n", JOURNAL_FILE);
+    exit(EXIT_FAILURE);
+  }
+  if (resume && journal == 0) {
+    fprintf(stderr, "Journal for another run `%s'\n", JOURNAL_FILE);
+    exit(EXIT_FAILURE);
+  }
+  if (resume) {
+    gcompleted = gcheckpointed = gresumed;
+  } else {
+    // Starting over skips nothing
+    gresumed = 0;
+  }
+  if (!resume && journal == 0) {
+    fprintf(stderr, "Leaving journal for another run `%s'\n", JOURNAL_FILE);
+    gforeign = 1;
+  }
+  atexit(checkpoint_on_exit);
+}
+
+/**
+ * Check whether we're continuing a previous run
+ */
+int is_resuming(void) { return gresuming; }
+
+/**
+ * Fail when the entries of a resumed run no longer line up
+ * with the journal, like after files were added beneath a
+ * layered directory, since skipping by count would miss some
+ */
+static void fail_out_of_date(void) {
+  fprintf(stderr, "Journal out of date `%s'\n", JOURNAL_FILE);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * Move on to the next entry in the run, giving whether it was
+ * already completed so it can be skipped without probing it
+ */
+int skip_entry(const char *path) {
+  if (gentries >= gresumed) {
+    gentries++;
+    return 0;
+  }
+  if (++gentries == gresumed && strcmp(path, gresumed_last)) {
+    fail_out_of_date();
+  }
+  snprintf(glast, PATH_MAX + 1, "%s", path);
+  return 1;
+}
+
+/**
+ * Mark the current entry as completed
+ * checkpointing at regular intervals
+ */
+void complete_entry(const char *path) {
+  snprintf(glast, PATH_MAX + 1, "%s", path);
+  gcompleted = gentries;
+  if (gcompleted - gcheckpointed >= JOURNAL_INTERVAL) {
+    write_checkpoint();
+  }
+}
+
+/**
+ * Hold checkpoints before the current entry since it was
+ * handed to the privileged helper, which might never run
+ */
+void hold_journal(void) {
+  if (gentries - 1 < gheld) {
+    gheld = gentries - 1;
+    // Everything before the current entry is completed
+    snprintf(gheld_last, PATH_MAX + 1, "%s", glast);
+  }
+}
+
+/**
+ * Let checkpoints pass entries held for the
+ * privileged helper once it confirms them all
+ */
+void release_journal(void) { gheld = LONG_MAX; }
+
+/**
+ * Remove the journal once every entry is completed
+ * unless it belongs to another run
+ */
+void finish_journal(void) {
+  if (gentries < gresumed) {
+    fail_out_of_date();
+  }
+  gfinished = 1;
+  if (gjournal != -1) {
+    close(gjournal);
+  }
+  if (!gforeign && unlink(JOURNAL_FILE) == -1 && errno != ENOENT) {
+    perror("Issue removing journal");
+  }
+}
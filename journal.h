@@ -0,0 +1,22 @@
+#include <stddef.h>
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+extern const char *JOURNAL_FILE;
+
+void start_journal(const char *command, char **paths, int count, int resume);
+
+int is_resuming(void);
+
+int skip_entry(const char *path);
+
+void complete_entry(const char *path);
+
+void hold_journal(void);
+
+void release_journal(void);
+
+void finish_journal(void);
+
+#endif
@@ -0,0 +1,253 @@
+#include "layer.h"
+#include "options/hidden.h"
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// The current directory is always the base layer
+// with any other layers given in the hidden options
+static const char *BASE_LAYER = ".";
+
+// Real paths for every layer resolved once per run
+static char **glayer_prefixes = NULL;
+
+/**
+ * Count all layers including the base
+ */
+int get_layer_count(void) { return ghidden_opts.lcount + 1; }
+
+/**
+ * Give the path for a layer where later
+ * layers take precedence over earlier ones
+ */
+static const char *get_layer(int layer) {
+  return layer ? ghidden_opts.lvalues[layer - 1] : BASE_LAYER;
+}
+
+/**
+ * Make the path for a relative path within a layer
+ * where an empty relative path is the layer itself
+ */
+static void make_layer_path(char *buf, int layer, const char *rpath) {
+  if (*rpath == '\0') {
+    snprintf(buf, PATH_MAX + 1, "%s", get_layer(layer));
+  } else {
+    snprintf(buf, PATH_MAX + 1, "%s/%s", get_layer(layer), rpath);
+  }
+}
+
+/**
+ * Resolve the real path of every layer the first
+ * time they're needed, failing for missing layers
+ */
+static void resolve_layer_prefixes(void) {
+  if (glayer_prefixes) {
+    return;
+  }
+  int count = get_layer_count();
+  glayer_prefixes = (char **)calloc(count, sizeof(char *));
+  for (int i = 0; i < count; i++) {
+    glayer_prefixes[i] = realpath(get_layer(i), NULL);
+    if (glayer_prefixes[i] == NULL) {
+      fprintf(stderr, "Non-existent layer `%s'\n", get_layer(i));
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/**
+ * Find the real path of the layer containing an absolute path,
+ * preferring the longest match since layers might be nested
+ */
+const char *find_layer_prefix(const char *abspath) {
+  resolve_layer_prefixes();
+  const char *found = NULL;
+  size_t foundlen = 0;
+  for (int i = 0; i < get_layer_count(); i++) {
+    const char *prefix = glayer_prefixes[i];
+    size_t length = strlen(prefix);
+    if (strncmp(abspath, prefix, length) || length < foundlen) {
+      continue;
+    }
+    if (abspath[length] == '/' || abspath[length] == '\0' ||
+        !strcmp(prefix, "/")) {
+      found = prefix;
+      foundlen = length;
+    }
+  }
+  return found;
+}
+
+/**
+ * Make a path given on the command-line relative to whichever
+ * layer contains it, where paths only found in other layers can
+ * be given relative to the base. Allocates memory for the
+ * returned pointer which needs to be freed by the caller.
+ */
+char *make_layer_relative_path(const char *path) {
+  char abspath[PATH_MAX + 1];
+  if (realpath(path, abspath)) {
+    const char *prefix = find_layer_prefix(abspath);
+    if (prefix == NULL) {
+      fprintf(stderr, "File outside project `%s'\n", path);
+      exit(EXIT_FAILURE);
+    }
+    const char *suffix = &abspath[strlen(prefix)];
+    if (*suffix == '/') {
+      suffix++;
+    }
+    return strdup(suffix);
+  }
+  while (!strncmp(path, "./", 2)) {
+    path += 2;
+  }
+  for (int i = 0; i < get_layer_count(); i++) {
+    char lpath[PATH_MAX + 1];
+    make_layer_path(lpath, i, path);
+    struct stat sb;
+    if (lstat(lpath, &sb) == 0) {
+      return strdup(path);
+    }
+  }
+  fprintf(stderr, "Non-existent file `%s'\n", path);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * Treat a single relative path merged across all layers where
+ * the highest precedence layer containing it wins. Returns 1
+ * when no layer contains the path.
+ */
+int treat_layered_path(const char *rpath, layer_treat_t treat) {
+  int winner = -1;
+  int isdir = 0;
+  int dirs = 0;
+  for (int i = 0; i < get_layer_count(); i++) {
+    char lpath[PATH_MAX + 1];
+    make_layer_path(lpath, i, rpath);
+    struct stat sb;
+    if (lstat(lpath, &sb) == 0) {
+      isdir = S_ISDIR(sb.st_mode);
+      dirs += isdir;
+      winner = i;
+    }
+  }
+  if (winner == -1) {
+    return 1;
+  }
+  char fpath[PATH_MAX + 1];
+  make_layer_path(fpath, winner, rpath);
+  if (treat(fpath, rpath, isdir, isdir && dirs > 1)) {
+    walk_layers(rpath, treat);
+  }
+  return 0;
+}
+
+/**
+ * Skip current and parent entries when scanning
+ */
+static int is_named_entry(const struct dirent *dent) {
+  return strcmp(dent->d_name, ".") && strcmp(dent->d_name, "..");
+}
+
+/**
+ * Order entries by their bytes so every
+ * layer sorts the same regardless of locale
+ */
+static int compare_entries(const struct dirent **a, const struct dirent **b) {
+  return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/**
+ * Check whether an entry within a layer is a directory
+ * falling back to lstat when d_type isn't filled in
+ */
+static int is_directory_entry(const struct dirent *dent, const char *path) {
+  if (dent->d_type != DT_UNKNOWN) {
+    return dent->d_type == DT_DIR;
+  }
+  struct stat sb;
+  return lstat(path, &sb) == 0 && S_ISDIR(sb.st_mode);
+}
+
+/**
+ * Walk the entries beneath a relative path for all layers at
+ * once using a k-way merge of their sorted directory streams, so
+ * each mapped path is treated exactly once using the highest
+ * precedence layer containing it
+ */
+void walk_layers(const char *rpath, layer_treat_t treat) {
+  int count = get_layer_count();
+  struct dirent ***entries =
+      (struct dirent ***)calloc(count, sizeof(struct dirent **));
+  int *sizes = (int *)calloc(count, sizeof(int));
+  int *heads = (int *)calloc(count, sizeof(int));
+  if (entries == NULL || sizes == NULL || heads == NULL) {
+    fprintf(stderr, "Failure allocating layers\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < count; i++) {
+    char dpath[PATH_MAX + 1];
+    make_layer_path(dpath, i, rpath);
+    // Layers missing the directory have nothing to merge
+    sizes[i] = scandir(dpath, &entries[i], is_named_entry, compare_entries);
+    if (sizes[i] < 0) {
+      sizes[i] = 0;
+    }
+  }
+  for (;;) {
+    const char *next = NULL;
+    for (int i = 0; i < count; i++) {
+      if (heads[i] < sizes[i]) {
+        const char *name = entries[i][heads[i]]->d_name;
+        if (next == NULL || strcmp(name, next) < 0) {
+          next = name;
+        }
+      }
+    }
+    if (next == NULL) {
+      break;
+    }
+    // Copying since heads move on
+    char name[NAME_MAX + 1];
+    snprintf(name, NAME_MAX + 1, "%s", next);
+    char nrpath[PATH_MAX + 1];
+    if (*rpath == '\0') {
+      snprintf(nrpath, PATH_MAX + 1, "%s", name);
+    } else {
+      snprintf(nrpath, PATH_MAX + 1, "%s/%s", rpath, name);
+    }
+    // Advance every layer sharing the smallest name
+    // where the last one found has the highest precedence
+    int winner = -1;
+    int isdir = 0;
+    int dirs = 0;
+    char fpath[PATH_MAX + 1];
+    for (int i = 0; i < count; i++) {
+      if (heads[i] < sizes[i] &&
+          !strcmp(entries[i][heads[i]]->d_name, name)) {
+        make_layer_path(fpath, i, nrpath);
+        isdir = is_directory_entry(entries[i][heads[i]], fpath);
+        dirs += isdir;
+        winner = i;
+        heads[i]++;
+      }
+    }
+    make_layer_path(fpath, winner, nrpath);
+    if (treat(fpath, nrpath, isdir, isdir && dirs > 1)) {
+      walk_layers(nrpath, treat);
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; j < sizes[i]; j++) {
+      free(entries[i][j]);
+    }
+    free(entries[i]);
+  }
+  free(entries);
+  free(sizes);
+  free(heads);
+}
@@ -0,0 +1,24 @@
+#include <stddef.h>
+
+#ifndef LAYER_H
+#define LAYER_H
+
+// Handles the winning entry for a mapped path given its
+// layer path, the path relative to every layer, whether it's
+// a directory, and whether lower layers share the directory.
+// Returning non-zero descends into the directory.
+typedef int (*layer_treat_t)(
+    const char *fpath, const char *rpath, int isdir, int merged
+);
+
+int get_layer_count(void);
+
+const char *find_layer_prefix(const char *abspath);
+
+char *make_layer_relative_path(const char *path);
+
+int treat_layered_path(const char *rpath, layer_treat_t treat);
+
+void walk_layers(const char *rpath, layer_treat_t treat);
+
+#endif
@@ -5,6 +5,20 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+/**
+ * Append a project layer where layers given
+ * later take precedence over earlier ones
+ */
+static void append_layer(hidden_opts_t *opts, char *layer) {
+  size_t size = (opts->lcount + 1) * sizeof(char *);
+  opts->lvalues = (char **)realloc(opts->lvalues, size);
+  if (opts->lvalues == NULL) {
+    fprintf(stderr, "Failure allocating layers\n");
+    exit(EXIT_FAILURE);
+  }
+  opts->lvalues[opts->lcount++] = layer;
+}
+
 /**
  * Setting of global hidden options used for debugging
  * which should be ignored by other option parsers
@@ -16,19 +30,30 @@ int set_hidden_options(
   // Disable errors globally
   // for hidden options
   opterr = 0;
-  const char *short_opt = "dfhlovr:";
+  const char *short_opt = "abcde:fhi:lL:opRvr:s:t:";
   // Allows handling for single characters
   struct option long_opt[] = {
       {"debug", no_argument, NULL, 'd'},
       // All subcommand options need to be ignored but this can
       // get tricky because different letters might represent
       // different options across all subcommands
+      {"adopt", no_argument, NULL, 'a'},
+      {"background", no_argument, NULL, 'b'},
+      {"exclude", required_argument, NULL, 'e'},
+      {"relative", no_argument, NULL, 'c'},
       {"force", no_argument, NULL, 'f'},
       {"help", no_argument, NULL, 'h'},
+      {"include", required_argument, NULL, 'i'},
       {"linked", no_argument, NULL, 'l'},
       {"owner", no_argument, NULL, 'o'},
+      {"parents", no_argument, NULL, 'p'},
+      {"resume", no_argument, NULL, 'R'},
       {"version", no_argument, NULL, 'v'},
       {"root", required_argument, NULL, 'r'},
+      {"layer", required_argument, NULL, 'L'},
+      {"side", required_argument, NULL, 's'},
+      {"since", required_argument, NULL, 's'},
+      {"timeout", required_argument, NULL, 't'},
       {NULL, 0, NULL, 0}
   };
   while ((option = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1) {
@@ -36,13 +61,25 @@ int set_hidden_options(
       case 'd':
         opts->dflag = 1;
         break;
+      case 'a':
+      case 'b':
+      case 'c':
+      case 'e':
       case 'f':
       case 'h':
+      case 'i':
       case 'l':
       case 'o':
+      case 'p':
+      case 'R':
       case 'v':
+      case 's':
+      case 't':
         // Ignore non-hidden options
         break;
+      case 'L':
+        append_layer(opts, optarg);
+        break;
       case 'r': {
         if (optarg) {
           opts->rvalue = optarg;
@@ -56,7 +93,8 @@ int set_hidden_options(
         break;
       }
       case '?':
-        if (optopt == 'r') {
+        if (optopt == 'e' || optopt == 'i' || optopt == 'L' ||
+            optopt == 'r' || optopt == 's' || optopt == 't') {
           fprintf(stderr, "Option -%c requires an argument.\n", optopt);
         } else if (isprint(optopt)) {
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -7,6 +7,8 @@
 typedef struct {
   int dflag;
   char *rvalue;
+  char **lvalues;
+  int lcount;
 } hidden_opts_t;
 
 extern hidden_opts_t ghidden_opts;
@@ -11,21 +11,29 @@
  */
 int set_link_options(int argc, char **argv, link_opts_t *opts, int *subind) {
   int option;
-  const char *short_opt = "dfhr:";
+  const char *short_opt = "cdfhL:pRr:";
   // Allows handling for single characters
   // debug option is a hidden global
   struct option long_opt[] = {
       {"debug", no_argument, NULL, 'd'},
+      {"relative", no_argument, NULL, 'c'},
       {"force", no_argument, NULL, 'f'},
       {"help", no_argument, NULL, 'h'},
+      {"parents", no_argument, NULL, 'p'},
+      {"resume", no_argument, NULL, 'R'},
       {"root", required_argument, NULL, 'r'},
+      {"layer", required_argument, NULL, 'L'},
       {NULL, 0, NULL, 0}
   };
   while ((option = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1) {
     switch (option) {
       case 'd':
+      case 'L':
       case 'r':
-        // Ignore hidden debug and root
+        // Ignore hidden debug, layer, and root
+        break;
+      case 'c':
+        opts->cflag = 1;
         break;
       case 'f':
         opts->fflag = 1;
@@ -33,6 +41,12 @@ int set_link_options(int argc, char **argv, link_opts_t *opts, int *subind) {
       case 'h':
         opts->hflag = 1;
         break;
+      case 'p':
+        opts->pflag = 1;
+        break;
+      case 'R':
+        opts->rflag = 1;
+        break;
       case '?':
         if (isprint(optopt)) {
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -53,7 +67,10 @@ int set_link_options(int argc, char **argv, link_opts_t *opts, int *subind) {
  */
 void print_link_options(int argc, char **argv, link_opts_t *opts) {
   printf("hflag = %d\n", opts->hflag);
+  printf("cflag = %d\n", opts->cflag);
   printf("fflag = %d\n", opts->fflag);
+  printf("pflag = %d\n", opts->pflag);
+  printf("rflag = %d\n", opts->rflag);
   for (int index = optind; index < argc; index++) {
     printf("Non-option argument %s\n", argv[index]);
   }
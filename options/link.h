@@ -6,7 +6,10 @@
 // Link command options
 typedef struct {
   int hflag;
+  int cflag;
   int fflag;
+  int pflag;
+  int rflag;
 } link_opts_t;
 
 int set_link_options(int argc, char **argv, link_opts_t *opts, int *subind);
@@ -5,38 +5,73 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+/**
+ * Append a value for options which can be given
+ * more than once, growing the list of values
+ */
+static void append_value(char ***values, int *count, char *value) {
+  *values = (char **)realloc(*values, (*count + 1) * sizeof(char *));
+  if (*values == NULL) {
+    fprintf(stderr, "Failure allocating option values\n");
+    exit(EXIT_FAILURE);
+  }
+  (*values)[(*count)++] = value;
+}
+
 /**
  * Setting of options when the program starts based on
  * command-line arguments given the list command
  */
 int set_list_options(int argc, char **argv, list_opts_t *opts, int *subind) {
   int option;
-  const char *short_opt = "dhlor:";
+  const char *short_opt = "bde:hi:lL:or:s:t:";
   // Allows handling for single characters
   // debug option is a hidden global
   struct option long_opt[] = {
+      {"background", no_argument, NULL, 'b'},
       {"debug", no_argument, NULL, 'd'},
+      {"exclude", required_argument, NULL, 'e'},
       {"help", no_argument, NULL, 'h'},
+      {"include", required_argument, NULL, 'i'},
       {"linked", no_argument, NULL, 'l'},
       {"owner", no_argument, NULL, 'o'},
       {"root", required_argument, NULL, 'r'},
+      {"layer", required_argument, NULL, 'L'},
+      {"side", required_argument, NULL, 's'},
+      {"timeout", required_argument, NULL, 't'},
       {NULL, 0, NULL, 0}
   };
   while ((option = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1) {
     switch (option) {
       case 'd':
+      case 'L':
       case 'r':
-        // Ignore hidden debug and root
+        // Ignore hidden debug, layer, and root
+        break;
+      case 'b':
+        opts->bflag = 1;
+        break;
+      case 'e':
+        append_value(&opts->evalues, &opts->ecount, optarg);
         break;
       case 'h':
         opts->hflag = 1;
         break;
+      case 'i':
+        append_value(&opts->ivalues, &opts->icount, optarg);
+        break;
       case 'l':
         opts->lflag = 1;
         break;
       case 'o':
         opts->oflag = 1;
         break;
+      case 's':
+        opts->svalue = optarg;
+        break;
+      case 't':
+        opts->tvalue = optarg;
+        break;
       case '?':
         if (isprint(optopt)) {
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -56,9 +91,18 @@ int set_list_options(int argc, char **argv, list_opts_t *opts, int *subind) {
  * Printing to ensure correctness
  */
 void print_list_options(int argc, char **argv, list_opts_t *opts) {
+  printf("bflag = %d\n", opts->bflag);
   printf("hflag = %d\n", opts->hflag);
   printf("lflag = %d\n", opts->hflag);
   printf("oflag = %d\n", opts->hflag);
+  printf("svalue = %s\n", opts->svalue);
+  printf("tvalue = %s\n", opts->tvalue);
+  for (int index = 0; index < opts->icount; index++) {
+    printf("ivalue = %s\n", opts->ivalues[index]);
+  }
+  for (int index = 0; index < opts->ecount; index++) {
+    printf("evalue = %s\n", opts->evalues[index]);
+  }
   for (int index = optind; index < argc; index++) {
     printf("Non-option argument %s\n", argv[index]);
   }
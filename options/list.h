@@ -5,9 +5,16 @@
 
 // List command options
 typedef struct {
+  int bflag;
   int hflag;
   int lflag;
   int oflag;
+  char *svalue;
+  char *tvalue;
+  char **ivalues;
+  int icount;
+  char **evalues;
+  int ecount;
 } list_opts_t;
 
 int set_list_options(int argc, char **argv, list_opts_t *opts, int *subind);
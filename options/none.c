@@ -10,7 +10,7 @@
  */
 int set_none_options(int argc, char **argv, none_opts_t *opts, int *subind) {
   int option;
-  const char *short_opt = "dhvr:";
+  const char *short_opt = "dhL:vr:";
   // Allows handling for single characters
   // debug option is a hidden global
   struct option long_opt[] = {
@@ -18,14 +18,16 @@ int set_none_options(int argc, char **argv, none_opts_t *opts, int *subind) {
       {"help", no_argument, NULL, 'h'},
       {"version", no_argument, NULL, 'v'},
       {"root", required_argument, NULL, 'r'},
+      {"layer", required_argument, NULL, 'L'},
       {NULL, 0, NULL, 0}
   };
   while ((option = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1) {
     switch (option) {
       case 'd':
+      case 'L':
       case 'r':
       case '?': {
-        // Ignore hidden debug, root, and ? for errors.
+        // Ignore hidden debug, layer, root, and ? for errors.
         // Come back to see if we shouldn't ignore errors.
         break;
       }
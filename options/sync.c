@@ -0,0 +1,67 @@
+#include "sync.h"
+#include <ctype.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * Setting of options when the program starts based on
+ * command-line arguments given the sync command
+ */
+int set_sync_options(int argc, char **argv, sync_opts_t *opts, int *subind) {
+  int option;
+  const char *short_opt = "adhL:r:s:";
+  // Allows handling for single characters
+  // debug option is a hidden global
+  struct option long_opt[] = {
+      {"adopt", no_argument, NULL, 'a'},
+      {"debug", no_argument, NULL, 'd'},
+      {"help", no_argument, NULL, 'h'},
+      {"since", required_argument, NULL, 's'},
+      {"root", required_argument, NULL, 'r'},
+      {"layer", required_argument, NULL, 'L'},
+      {NULL, 0, NULL, 0}
+  };
+  while ((option = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1) {
+    switch (option) {
+      case 'd':
+      case 'L':
+      case 'r':
+        // Ignore hidden debug, layer, and root
+        break;
+      case 'a':
+        opts->aflag = 1;
+        break;
+      case 'h':
+        opts->hflag = 1;
+        break;
+      case 's':
+        opts->svalue = optarg;
+        break;
+      case '?':
+        if (isprint(optopt)) {
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        } else {
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        }
+        return 1;
+      default:
+        abort();
+    }
+  }
+  *subind = optind;
+  return 0;
+}
+
+/**
+ * Printing to ensure correctness
+ */
+void print_sync_options(int argc, char **argv, sync_opts_t *opts) {
+  printf("aflag = %d\n", opts->aflag);
+  printf("hflag = %d\n", opts->hflag);
+  printf("svalue = %s\n", opts->svalue);
+  for (int index = optind; index < argc; index++) {
+    printf("Non-option argument %s\n", argv[index]);
+  }
+}
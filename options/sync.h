@@ -0,0 +1,17 @@
+#include <stddef.h>
+
+#ifndef SYNC_OPTIONS_H
+#define SYNC_OPTIONS_H
+
+// Sync command options
+typedef struct {
+  int aflag;
+  int hflag;
+  char *svalue;
+} sync_opts_t;
+
+int set_sync_options(int argc, char **argv, sync_opts_t *opts, int *subind);
+
+void print_sync_options(int argc, char **argv, sync_opts_t *opts);
+
+#endif
@@ -13,24 +13,30 @@ int set_unlink_options(
     int argc, char **argv, unlink_opts_t *opts, int *subind
 ) {
   int option;
-  const char *short_opt = "dhr:";
+  const char *short_opt = "dhL:Rr:";
   // Allows handling for single characters
   // debug option is a hidden global
   struct option long_opt[] = {
       {"debug", no_argument, NULL, 'd'},
       {"help", no_argument, NULL, 'h'},
+      {"resume", no_argument, NULL, 'R'},
       {"root", required_argument, NULL, 'r'},
+      {"layer", required_argument, NULL, 'L'},
       {NULL, 0, NULL, 0}
   };
   while ((option = getopt_long(argc, argv, short_opt, long_opt, NULL)) != -1) {
     switch (option) {
       case 'd':
+      case 'L':
       case 'r':
-        // Ignore hidden debug and root
+        // Ignore hidden debug, layer, and root
         break;
       case 'h':
         opts->hflag = 1;
         break;
+      case 'R':
+        opts->rflag = 1;
+        break;
       case '?':
         if (isprint(optopt)) {
           fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -51,6 +57,7 @@ int set_unlink_options(
  */
 void print_unlink_options(int argc, char **argv, unlink_opts_t *opts) {
   printf("hflag = %d\n", opts->hflag);
+  printf("rflag = %d\n", opts->rflag);
   for (int index = optind; index < argc; index++) {
     printf("Non-option argument %s\n", argv[index]);
   }
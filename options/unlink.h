@@ -6,6 +6,7 @@
 // Unlink command options
 typedef struct {
   int hflag;
+  int rflag;
 } unlink_opts_t;
 
 int set_unlink_options(int argc, char **argv, unlink_opts_t *opts, int *subind);
@@ -0,0 +1,181 @@
+#include "probe.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Workers started with the pool and the most we allow
+// when replacing workers stuck on a hung filesystem
+static int gpool_workers = 4;
+static int gpool_max_workers = 16;
+
+// A single probe shared between the caller waiting on
+// it and the worker running it, where abandoned probes
+// are freed by the worker once it finally returns
+typedef struct request {
+  char path[PATH_MAX + 1];
+  struct stat sb;
+  int err;
+  int picked;
+  int done;
+  int abandoned;
+  struct request *next;
+} request_t;
+
+static pthread_mutex_t gmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gqueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t gdone = PTHREAD_COND_INITIALIZER;
+static request_t *ghead = NULL;
+static request_t *gtail = NULL;
+static int gworkers = 0;
+
+/**
+ * Take requests off the queue and run them until the pool
+ * has more workers than it needs after replacing stuck ones
+ */
+static void *run_worker(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&gmutex);
+  for (;;) {
+    while (ghead == NULL) {
+      pthread_cond_wait(&gqueued, &gmutex);
+    }
+    request_t *request = ghead;
+    ghead = request->next;
+    if (ghead == NULL) {
+      gtail = NULL;
+    }
+    request->picked = 1;
+    pthread_mutex_unlock(&gmutex);
+    // This is the only call that might hang
+    int err = stat(request->path, &request->sb) == -1 ? errno : 0;
+    pthread_mutex_lock(&gmutex);
+    if (request->abandoned) {
+      free(request);
+      // We were replaced while stuck
+      if (gworkers > gpool_workers) {
+        gworkers--;
+        break;
+      }
+      continue;
+    }
+    request->err = err;
+    request->done = 1;
+    pthread_cond_broadcast(&gdone);
+  }
+  pthread_mutex_unlock(&gmutex);
+  return NULL;
+}
+
+/**
+ * Start a detached worker, expecting the lock to be held
+ */
+static void start_worker(void) {
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, run_worker, NULL) != 0) {
+    fprintf(stderr, "Failure starting probe worker\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_detach(thread);
+  gworkers++;
+}
+
+/**
+ * Remove a request which no worker has picked up yet
+ * from the queue, expecting the lock to be held
+ */
+static void dequeue(request_t *request) {
+  request_t *previous = NULL;
+  for (request_t *current = ghead; current; current = current->next) {
+    if (current == request) {
+      if (previous) {
+        previous->next = current->next;
+      } else {
+        ghead = current->next;
+      }
+      if (gtail == current) {
+        gtail = previous;
+      }
+      return;
+    }
+    previous = current;
+  }
+}
+
+/**
+ * Limit how many probes run at once, which
+ * only applies before the first probe
+ */
+void limit_probes(int workers, int max_workers) {
+  pthread_mutex_lock(&gmutex);
+  gpool_workers = workers;
+  gpool_max_workers = max_workers;
+  pthread_mutex_unlock(&gmutex);
+}
+
+/**
+ * Read file stats through the worker pool, waiting at most the
+ * timeout given in milliseconds so one stuck path on a hung or
+ * slow filesystem can't block the caller
+ */
+probe_t probe_stat(const char *path, struct stat *sb, int timeout) {
+  request_t *request = (request_t *)calloc(1, sizeof(request_t));
+  if (request == NULL) {
+    fprintf(stderr, "Failure allocating probe\n");
+    exit(EXIT_FAILURE);
+  }
+  snprintf(request->path, PATH_MAX + 1, "%s", path);
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout / 1000;
+  deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&gmutex);
+  // Lazily start the pool on the first probe
+  while (gworkers < gpool_workers) {
+    start_worker();
+  }
+  if (gtail) {
+    gtail->next = request;
+  } else {
+    ghead = request;
+  }
+  gtail = request;
+  pthread_cond_signal(&gqueued);
+  while (!request->done) {
+    if (pthread_cond_timedwait(&gdone, &gmutex, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  if (!request->done) {
+    if (request->picked) {
+      // The worker owns the request now and we
+      // replace it since it's likely stuck for good
+      request->abandoned = 1;
+      if (gworkers < gpool_max_workers) {
+        start_worker();
+      }
+    } else {
+      dequeue(request);
+      free(request);
+    }
+    pthread_mutex_unlock(&gmutex);
+    return PROBE_TIMEOUT;
+  }
+  pthread_mutex_unlock(&gmutex);
+  probe_t probe = PROBE_FOUND;
+  if (request->err) {
+    errno = request->err;
+    probe = PROBE_MISSING;
+  } else {
+    memcpy(sb, &request->sb, sizeof(struct stat));
+  }
+  free(request);
+  return probe;
+}
@@ -0,0 +1,14 @@
+#include <stddef.h>
+#include <sys/stat.h>
+
+#ifndef PROBE_H
+#define PROBE_H
+
+// Outcome of a probe bounded by a deadline
+typedef enum { PROBE_FOUND, PROBE_MISSING, PROBE_TIMEOUT } probe_t;
+
+void limit_probes(int workers, int max_workers);
+
+probe_t probe_stat(const char *path, struct stat *sb, int timeout);
+
+#endif
@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Preloadable shim counting calls made by stuff so
+// tests can assert a syscall budget for each entry,
+// which also denies writes beneath STUFF_DENY_PREFIX
+// so tests can escalate without a root-owned root and
+// stalls stats beneath STUFF_STALL_PREFIX so tests can
+// probe as if the root sat on a hung filesystem
+
+// Provided by glibc which lets us avoid dlsym
+// for malloc since dlsym can allocate itself
+extern void *__libc_malloc(size_t size);
+
+static unsigned long stat_count = 0;
+static unsigned long lstat_count = 0;
+static unsigned long realpath_count = 0;
+static unsigned long open_count = 0;
+static unsigned long noatime_count = 0;
+static unsigned long symlink_count = 0;
+static unsigned long mkdir_count = 0;
+static unsigned long malloc_count = 0;
+
+// Seconds a stalled stat takes which
+// outlasts any deadline tests give
+#define STALL_SECONDS 2
+
+/**
+ * Look up the next definition of a symbol
+ * which is the one we're wrapping
+ */
+static void *next(const char *symbol) {
+  void *fn = dlsym(RTLD_NEXT, symbol);
+  if (fn == NULL) {
+    fprintf(stderr, "Missing symbol `%s'\n", symbol);
+    abort();
+  }
+  return fn;
+}
+
+/**
+ * Check whether a path sits beneath the prefix
+ * given by an environment variable if it's set
+ */
+static int is_beneath(const char *path, const char *variable) {
+  const char *prefix = getenv(variable);
+  return prefix && *prefix && !strncmp(path, prefix, strlen(prefix));
+}
+
+int stat(const char *path, struct stat *sb) {
+  static int (*fn)(const char *, struct stat *) = NULL;
+  if (fn == NULL) {
+    fn = next("stat");
+  }
+  stat_count++;
+  if (is_beneath(path, "STUFF_STALL_PREFIX")) {
+    sleep(STALL_SECONDS);
+  }
+  return fn(path, sb);
+}
+
+int lstat(const char *path, struct stat *sb) {
+  static int (*fn)(const char *, struct stat *) = NULL;
+  if (fn == NULL) {
+    fn = next("lstat");
+  }
+  lstat_count++;
+  return fn(path, sb);
+}
+
+char *realpath(const char *path, char *resolved) {
+  static char *(*fn)(const char *, char *) = NULL;
+  if (fn == NULL) {
+    fn = next("realpath");
+  }
+  realpath_count++;
+  return fn(path, resolved);
+}
+
+int open(const char *path, int flags, ...) {
+  static int (*fn)(const char *, int, ...) = NULL;
+  if (fn == NULL) {
+    fn = next("open");
+  }
+  mode_t mode = 0;
+  // Mode is only passed when creating
+  if (flags & (O_CREAT | O_TMPFILE)) {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  open_count++;
+  if (flags & O_NOATIME) {
+    noatime_count++;
+  }
+  return fn(path, flags, mode);
+}
+
+/**
+ * Check whether writing a path should fail as
+ * if we didn't have permission to write it
+ */
+static int is_denied(const char *path) {
+  return is_beneath(path, "STUFF_DENY_PREFIX");
+}
+
+int symlink(const char *target, const char *path) {
+  static int (*fn)(const char *, const char *) = NULL;
+  if (fn == NULL) {
+    fn = next("symlink");
+  }
+  symlink_count++;
+  if (is_denied(path)) {
+    errno = EACCES;
+    return -1;
+  }
+  return fn(target, path);
+}
+
+int mkdir(const char *path, mode_t mode) {
+  static int (*fn)(const char *, mode_t) = NULL;
+  if (fn == NULL) {
+    fn = next("mkdir");
+  }
+  mkdir_count++;
+  return fn(path, mode);
+}
+
+int remove(const char *path) {
+  static int (*fn)(const char *) = NULL;
+  if (fn == NULL) {
+    fn = next("remove");
+  }
+  if (is_denied(path)) {
+    errno = EACCES;
+    return -1;
+  }
+  return fn(path);
+}
+
+void *malloc(size_t size) {
+  malloc_count++;
+  return __libc_malloc(size);
+}
+
+/**
+ * Write all counts when stuff exits to the file given by
+ * STUFF_COUNT_FILE, otherwise counts are quietly dropped
+ */
+__attribute__((destructor)) static void report(void) {
+  const char *filename = getenv("STUFF_COUNT_FILE");
+  if (filename == NULL) {
+    return;
+  }
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) {
+    return;
+  }
+  fprintf(file, "stat %lu\n", stat_count);
+  fprintf(file, "lstat %lu\n", lstat_count);
+  fprintf(file, "realpath %lu\n", realpath_count);
+  fprintf(file, "open %lu\n", open_count);
+  fprintf(file, "noatime %lu\n", noatime_count);
+  fprintf(file, "symlink %lu\n", symlink_count);
+  fprintf(file, "mkdir %lu\n", mkdir_count);
+  fprintf(file, "malloc %lu\n", malloc_count);
+  fclose(file);
+}
@@ -4,6 +4,8 @@
 # All paths specified relative to this assumption
 
 OUTPUT_FOLDER="../output"
+COUNT_SHIM="${PWD}/../count.so"
+COUNT_FILE="../count.txt"
 ANSI_FORMAT_BOLD="\e[1m"
 ANSI_COLOR_GREEN="\x1b[32m"
 ANSI_COLOR_RED="\x1b[31m"
@@ -53,7 +55,84 @@ assert_empty_directory() {
 # Asserts that the root folder at the same level of
 # the current directory contains what we expect
 assert_root_contents() {
-  diff <(find "../root" -type l) <(echo "$1")
+  diff <(find "../root" -type l | sort) <(echo "$1" | sort)
+}
+
+# Runs a command with writes beneath a prefix denied by the
+# preloaded shim, running the helper directly for escalations
+run_denied() {
+  STUFF_ESCALATE="" STUFF_DENY_PREFIX="$1" LD_PRELOAD="$COUNT_SHIM" "${@:2}"
+}
+
+# Runs a command with stats beneath a prefix stalled by the
+# preloaded shim as if it sat on a hung filesystem
+run_stalled() {
+  STUFF_STALL_PREFIX="$1" LD_PRELOAD="$COUNT_SHIM" "${@:2}"
+}
+
+# Runs a command with the counting shim preloaded and asserts
+# calls stay within budgets like "realpath=1+2" meaning at most
+# one call for each listed entry plus two calls overall, failing
+# when the command fails or leaves no entries or counts behind
+assert_budget() {
+  rm -f "$COUNT_FILE"
+  output=$(STUFF_COUNT_FILE="$COUNT_FILE" LD_PRELOAD="$COUNT_SHIM" $1)
+  status=$?
+  entries=$(printf "%s" "$output" | grep --count "")
+  if ((status != 0)); then
+    echo "Command failed with status ${status}"
+  elif [[ ! -f $COUNT_FILE ]]; then
+    echo "Missing counts in ${COUNT_FILE}"
+  elif ((entries == 0)); then
+    echo "Missing entries for budgets"
+  fi
+  for budget in "${@:2}"; do
+    name="${budget%%=*}"
+    limit="${budget#*=}"
+    per_entry="${limit%%+*}"
+    [[ $limit == *+* ]] && overall="${limit#*+}" || overall=0
+    calls=$(awk -v name="$name" '$1 == name { print $2 }' "$COUNT_FILE" 2>/dev/null)
+    max=$((per_entry * entries + overall))
+    if [[ -z $calls ]]; then
+      echo "Missing count for ${name}"
+    elif ((calls > max)); then
+      echo "Budget exceeded for ${name} with ${calls} > ${max}"
+    fi
+  done
+  rm -f "$COUNT_FILE"
+}
+
+# Creates a git project next to the current one with a
+# first commit linked into the root and a second commit
+# renaming, adding, and removing paths, where "packed"
+# moves every object into a pack with deltas and "worktree"
+# makes the project a worktree of another repository
+# pointing at its gitdir with a relative path
+make_sync_project() {
+  rm -rf ../sync ../sync-main
+  if [[ $1 == worktree ]]; then
+    git -c init.defaultBranch=main init --quiet ../sync-main
+    git -C ../sync-main -c user.name=stuff -c user.email=stuff@localhost commit --quiet --allow-empty --message zero
+    git -C ../sync-main worktree add --quiet ../sync
+    echo "gitdir: ../sync-main/.git/worktrees/sync" >../sync/.git
+  else
+    git -c init.defaultBranch=main init --quiet ../sync
+  fi
+  mkdir -p ../sync/home ../sync/config/app
+  (
+    cd ../sync || exit
+    echo a >home/.a && echo b >home/.b && echo gone >home/.gone
+    echo x >config/app/x
+    git add --all
+    git -c user.name=stuff -c user.email=stuff@localhost commit --quiet --message one
+    stuff link --root ../root --parents ./home/.a ./home/.gone ./config/app >/dev/null
+    git mv home/.a home/.e && git rm --quiet home/.gone
+    echo c >home/.c && echo y >config/app/y
+    mkdir other && echo z >other/z
+    git add --all
+    git -c user.name=stuff -c user.email=stuff@localhost commit --quiet --message two
+    [[ $1 == packed ]] && git repack -adq
+  )
 }
 
 # Test suite calling stuff without a
@@ -130,6 +209,110 @@ suite_stuff_link() {
   process_result "$output_link_folder"
   rm -rf ../root/folder
 
+  command="stuff link --root ../root --parents ./.one ./folder/.two"
+  file="test_stuff_link_parents"
+  output_link_parents=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_link_parents+=$(assert_root_contents "$(printf '%s\n' ../root/.one ../root/folder/.two)")
+  title="should link many paths creating missing parents when asked"
+  make_title "$output_link_parents" "$title"
+  process_result "$output_link_parents"
+  rm -rf ../root/.one ../root/folder
+
+  command="stuff link --root ../root --relative --parents ./.one ./folder/.two"
+  file="test_stuff_link_relative"
+  output_link_relative=$(diff <($command 2>&1) "${OUTPUT_FOLDER}/${file}")
+  output_link_relative+=$(diff <(readlink ../root/.one ../root/folder/.two) <(printf '%s\n' ../project/.one ../../project/folder/.two))
+  title="should link using the shortest relative paths when asked"
+  make_title "$output_link_relative" "$title"
+  process_result "$output_link_relative"
+  rm -rf ../root/.one ../root/folder
+
+  command="stuff link --root .. --relative --parents ./folder/.two ./.one"
+  output_link_inside=$($command 2>/dev/null >/dev/null && readlink ../.one | diff - <(echo project/.one))
+  output_link_inside+=$([[ -f ../.one ]] || echo "Dangling link")
+  title="should link relative paths when the project sits inside the root"
+  make_title "$output_link_inside" "$title"
+  process_result "$output_link_inside"
+  rm -rf ../.one ../folder
+
+  mkdir ../root/folder
+  command="stuff link --root ../root --parents ./.one ./folder/.two"
+  file="test_stuff_link_parents"
+  output_link_escalate=$(diff <(run_denied "$(realpath ../root)/folder/" $command) "${OUTPUT_FOLDER}/${file}")
+  output_link_escalate+=$(assert_root_contents "$(printf '%s\n' ../root/.one ../root/folder/.two)")
+  title="should batch denied links to the helper"
+  make_title "$output_link_escalate" "$title"
+  process_result "$output_link_escalate"
+  rm -rf ../root/.one ../root/folder
+
+  mkdir ../root/folder
+  command="stuff link --root ../root ./folder/.two"
+  output_link_installed=$(STUFF_ESCALATE="env -i" STUFF_DENY_PREFIX="$(realpath ../root)/folder/" LD_PRELOAD="$COUNT_SHIM" $command 2>&1 | grep --extended-regexp --quiet "^(Non-existent|Unsafe) helper \`/usr/local/libexec/stuff-helper'$" || echo "Escalated without an installed helper")
+  output_link_installed+=$(find ../root -type l)
+  title="should only escalate through a root-owned installed helper"
+  make_title "$output_link_installed" "$title"
+  process_result "$output_link_installed"
+  rm -rf ../root/folder
+
+  command="stuff link --root ../root --layer ../overlay --parents ./.one ./folder"
+  file="test_stuff_link_layers"
+  output_link_layers=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_link_layers+=$(assert_root_contents "$(printf '%s\n' ../root/.one ../root/folder/.three ../root/folder/.two)")
+  title="should link the highest layer once when given layers"
+  make_title "$output_link_layers" "$title"
+  process_result "$output_link_layers"
+  rm -rf ../root/.one ../root/folder
+
+  command="stuff link --root ../root ./.one ./folder/.two"
+  file="test_stuff_link_file"
+  output_link_checkpoint=$(diff <($command 2>/dev/null) "${OUTPUT_FOLDER}/${file}")
+  output_link_checkpoint+=$(grep --quiet "^done 1 ./.one$" .stuff-journal || echo "Missing checkpoint")
+  title="should checkpoint completed links when failing partway"
+  make_title "$output_link_checkpoint" "$title"
+  process_result "$output_link_checkpoint"
+
+  command="stuff link --root ../root --parents --resume ./.one ./folder/.two"
+  file="test_stuff_link_resume"
+  output_link_resume=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_link_resume+=$(assert_root_contents "$(printf '%s\n' ../root/.one ../root/folder/.two)")
+  output_link_resume+=$([[ -e .stuff-journal ]] && echo "Leftover journal")
+  title="should resume from the last checkpoint when asked"
+  make_title "$output_link_resume" "$title"
+  process_result "$output_link_resume"
+  rm -rf ../root/.one ../root/folder
+
+  mkdir ../bulk && touch ../bulk/f{00..65}
+  printf '#!/bin/sh\nkill -KILL "$PPID"\n' >../bulk-helper && chmod +x ../bulk-helper
+  helper="$(realpath ../bulk-helper)"
+  deny="$(realpath ../root)/f01"
+  (cd ../bulk && STUFF_ESCALATE="$helper" STUFF_DENY_PREFIX="$deny" LD_PRELOAD="$COUNT_SHIM" stuff link --root ../root ./f{00..65}) >/dev/null 2>&1
+  output_link_held=$(grep --quiet "^done 1 ./f00$" ../bulk/.stuff-journal || echo "Checkpoint past a held entry")
+  (cd ../bulk && stuff link --root ../root --resume ./f{00..65}) >/dev/null
+  output_link_held+=$([[ -L ../root/f01 ]] || echo "Missing held link")
+  title="should hold checkpoints at links the helper never confirmed"
+  make_title "$output_link_held" "$title"
+  process_result "$output_link_held"
+  rm -rf ../bulk ../bulk-helper ../root/f{00..65}
+
+  printf '%s\n' "command link" "root ../root" "layer ../overlay" "path ./folder" "done 1 ./folder/.gone" >.stuff-journal
+  command="stuff link --root ../root --layer ../overlay --resume ./folder"
+  output_link_stale=$($command 2>&1 | diff - <(echo "Journal out of date \`.stuff-journal'"))
+  output_link_stale+=$(find ../root -type l)
+  title="should refuse to resume when entries have shifted"
+  make_title "$output_link_stale" "$title"
+  process_result "$output_link_stale"
+  rm .stuff-journal
+
+  printf '%s\n' "command link" "root ../root" "path ./folder" "done 1 ./folder/.two" >../journal.txt
+  cp ../journal.txt .stuff-journal
+  command="stuff link --root ../root ./.one"
+  output_link_foreign=$($command 2>&1 >/dev/null | diff - <(echo "Leaving journal for another run \`.stuff-journal'"))
+  output_link_foreign+=$(diff .stuff-journal ../journal.txt)
+  title="should leave the journal of another run alone"
+  make_title "$output_link_foreign" "$title"
+  process_result "$output_link_foreign"
+  rm .stuff-journal ../journal.txt ../root/.one
+
   ln --symbolic "${PWD}/.one" ../root/.one
   command="stuff link --root ../root --force ./.one"
   file="test_stuff_link_file"
@@ -166,6 +349,62 @@ suite_stuff_list() {
   make_title "$output_list_help" "$title"
   process_result "$output_list_help"
 
+  ln --symbolic ../project/folder ../root/folder
+  command="stuff list --root ../root --linked --side root"
+  file="test_stuff_list_linked_folder"
+  output_list_relative=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should list relative links from the root side"
+  make_title "$output_list_relative" "$title"
+  process_result "$output_list_relative"
+  rm ../root/folder
+
+  ln --symbolic "${PWD}/folder" ../root/folder
+  command="stuff list --root ../root --linked --side root --background"
+  file="test_stuff_list_linked_folder"
+  output_list_background=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should list the same links when run in the background"
+  make_title "$output_list_background" "$title"
+  process_result "$output_list_background"
+  rm ../root/folder
+
+  command="stuff list --root ../root --background"
+  file="test_stuff_list"
+  output_list_noatime=$(diff <(STUFF_COUNT_FILE="$COUNT_FILE" LD_PRELOAD="$COUNT_SHIM" $command) "${OUTPUT_FOLDER}/${file}")
+  directories=$(find . -type d | wc -l)
+  output_list_noatime+=$(awk -v want="$directories" '$1 == "noatime" && $2 != want { print "Opened " $2 " of " want " directories without access times" }' "$COUNT_FILE")
+  rm -f "$COUNT_FILE"
+  title="should walk the project without access times in the background"
+  make_title "$output_list_noatime" "$title"
+  process_result "$output_list_noatime"
+
+  command="stuff list --root ../root ./folder"
+  file="test_stuff_list_path"
+  output_list_path=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should list only beneath a path when given a path"
+  make_title "$output_list_path" "$title"
+  process_result "$output_list_path"
+
+  command="stuff list --root ../root --exclude folder"
+  file="test_stuff_list_exclude"
+  output_list_exclude=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should skip excluded folders and their contents"
+  make_title "$output_list_exclude" "$title"
+  process_result "$output_list_exclude"
+
+  command="stuff list --root ../root --include *.two"
+  file="test_stuff_list_include"
+  output_list_include=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should only list included files when given globs"
+  make_title "$output_list_include" "$title"
+  process_result "$output_list_include"
+
+  command="stuff list --root ../root --layer ../overlay"
+  file="test_stuff_list_layers"
+  output_list_layers=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should list merged project contents when given layers"
+  make_title "$output_list_layers" "$title"
+  process_result "$output_list_layers"
+
   command="stuff list --root ../root --linked"
   file="test_stuff_list_linked_empty"
   output_list_empty=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
@@ -191,6 +430,72 @@ suite_stuff_list() {
   process_result "$output_list_folder"
   rm -rf ../root/folder
 
+  ln --symbolic "${PWD}/.one" ../root/.one
+  command="stuff list --root ../root --linked --side root"
+  file="test_stuff_list_linked_file"
+  output_list_root=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should filter linked files when walking the root side"
+  make_title "$output_list_root" "$title"
+  process_result "$output_list_root"
+  rm ../root/.one
+
+  ln --symbolic "${PWD}/folder" ../root/folder
+  command="stuff list --root ../root --linked --side root"
+  file="test_stuff_list_linked_folder"
+  output_list_root_folder=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should filter linked folders when walking the root side"
+  make_title "$output_list_root_folder" "$title"
+  process_result "$output_list_root_folder"
+  rm -rf ../root/folder
+
+  ln --symbolic "${PWD}/.one" ../root/.hop
+  ln --symbolic .hop ../root/.one
+  command="stuff list --root ../root --linked --side root"
+  file="test_stuff_list_linked_file"
+  output_list_root_chain=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should follow link chains when walking the root side"
+  make_title "$output_list_root_chain" "$title"
+  process_result "$output_list_root_chain"
+  rm ../root/.one ../root/.hop
+
+  mkdir ../root/other
+  ln --symbolic other ../root/folder
+  ln --symbolic "${PWD}/folder/.two" ../root/other/.two
+  command="stuff list --root ../root --linked --side root"
+  file="test_stuff_list_linked_nested"
+  output_list_root_through=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should descend into linked root directories when walking the root side"
+  make_title "$output_list_root_through" "$title"
+  process_result "$output_list_root_through"
+  rm -rf ../root/folder ../root/other
+
+  ln --symbolic "${PWD}/folder" ../root/folder
+  command="stuff list --root ../root --linked --timeout 1000"
+  file="test_stuff_list_linked_folder"
+  output_list_timeout=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should filter linked folders when probes have a deadline"
+  make_title "$output_list_timeout" "$title"
+  process_result "$output_list_timeout"
+  rm -rf ../root/folder
+
+  ln --symbolic "${PWD}/folder" ../root/folder
+  command="stuff list --root ../root --linked --timeout 100"
+  file="test_stuff_list_linked_stalled"
+  output_list_stalled=$(diff <(run_stalled "$(realpath ../root)/" $command 2>&1) "${OUTPUT_FOLDER}/${file}")
+  title="should show links as unknown when probes miss their deadline"
+  make_title "$output_list_stalled" "$title"
+  process_result "$output_list_stalled"
+  rm -rf ../root/folder
+
+  ln --symbolic "${PWD}/folder" ../root/folder
+  command="stuff list --root ../root --linked --side project"
+  file="test_stuff_list_linked_folder"
+  output_list_project=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should filter linked folders when walking the project side"
+  make_title "$output_list_project" "$title"
+  process_result "$output_list_project"
+  rm -rf ../root/folder
+
   process_suite "$DID_SUITE_PASS"
 
   echo ""
@@ -234,6 +539,143 @@ suite_stuff_unlink() {
   make_title "$output_unlink_folder" "$title"
   process_result "$output_unlink_folder"
 
+  ln --symbolic "${PWD}/folder" ../root/folder
+  command="stuff unlink --root ../root ./folder"
+  file="test_stuff_unlink_folder"
+  output_unlink_escalate=$(diff <(run_denied "$(realpath ../root)/" $command) "${OUTPUT_FOLDER}/${file}")
+  output_unlink_escalate+=$(assert_empty_directory "../root")
+  title="should batch denied unlinks to the helper"
+  make_title "$output_unlink_escalate" "$title"
+  process_result "$output_unlink_escalate"
+
+  ln --symbolic ../project/folder ../root/folder
+  command="stuff unlink --root ../root ./folder"
+  file="test_stuff_unlink_folder"
+  output_unlink_relative=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_unlink_relative+=$(assert_empty_directory "../root")
+  title="should unlink a folder linked with a relative path"
+  make_title "$output_unlink_relative" "$title"
+  process_result "$output_unlink_relative"
+
+  mkdir ../root/folder
+  ln --symbolic "${PWD}/folder/.two" ../root/folder/.two
+  ln --symbolic "${PWD}/../overlay/folder/.three" ../root/folder/.three
+  command="stuff unlink --root ../root --layer ../overlay ./folder"
+  file="test_stuff_unlink_layers"
+  output_unlink_layers=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_unlink_layers+=$(assert_empty_directory "../root")
+  title="should unlink each layer entry when given a shared folder"
+  make_title "$output_unlink_layers" "$title"
+  process_result "$output_unlink_layers"
+  rm -rf ../root/folder
+
+  process_suite "$DID_SUITE_PASS"
+
+  echo ""
+}
+
+# Test suite calling stuff sync with a git
+# project changed between two commits
+suite_stuff_sync() {
+  SUITES+=1
+  echo "  stuff sync subcommand"
+
+  command="stuff sync"
+  file="test_stuff_sync_help"
+  output_sync_help=$(diff <($command) "${OUTPUT_FOLDER}/${file}")
+  title="should show help when called without a revision"
+  make_title "$output_sync_help" "$title"
+  process_result "$output_sync_help"
+
+  make_sync_project
+  command="stuff sync --root ../root --since HEAD~1"
+  file="test_stuff_sync"
+  output_sync=$(cd ../sync && diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_sync+=$(assert_root_contents "$(printf '%s\n' ../root/config/app ../root/home/.e)")
+  title="should relink renamed paths and unlink removed ones"
+  make_title "$output_sync" "$title"
+  process_result "$output_sync"
+  rm -rf ../root/config ../root/home
+
+  make_sync_project
+  command="stuff sync --root ../root --adopt --since HEAD~1"
+  file="test_stuff_sync_adopt"
+  output_sync_adopt=$(cd ../sync && diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_sync_adopt+=$(assert_root_contents "$(printf '%s\n' ../root/config/app ../root/home/.c ../root/home/.e)")
+  title="should link added paths next to linked siblings when adopting"
+  make_title "$output_sync_adopt" "$title"
+  process_result "$output_sync_adopt"
+  rm -rf ../root/config ../root/home
+
+  make_sync_project
+  command="stuff sync --root ../root --since $(git -C ../sync rev-parse --short HEAD~1)"
+  file="test_stuff_sync"
+  output_sync_abbrev=$(cd ../sync && diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_sync_abbrev+=$(assert_root_contents "$(printf '%s\n' ../root/config/app ../root/home/.e)")
+  title="should resolve abbreviated hashes from loose objects"
+  make_title "$output_sync_abbrev" "$title"
+  process_result "$output_sync_abbrev"
+  rm -rf ../root/config ../root/home
+
+  make_sync_project packed
+  command="stuff sync --root ../root --since $(git -C ../sync rev-parse --short main^)"
+  file="test_stuff_sync"
+  output_sync_packed=$(cd ../sync && diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_sync_packed+=$(assert_root_contents "$(printf '%s\n' ../root/config/app ../root/home/.e)")
+  title="should read the same changes and abbreviations from packed objects"
+  make_title "$output_sync_packed" "$title"
+  process_result "$output_sync_packed"
+  rm -rf ../root/config ../root/home
+
+  make_sync_project worktree
+  command="stuff sync --root ../root --since HEAD~1"
+  file="test_stuff_sync"
+  output_sync_worktree=$(cd ../sync && diff <($command) "${OUTPUT_FOLDER}/${file}")
+  output_sync_worktree+=$(assert_root_contents "$(printf '%s\n' ../root/config/app ../root/home/.e)")
+  title="should read changes from a worktree of another repository"
+  make_title "$output_sync_worktree" "$title"
+  process_result "$output_sync_worktree"
+  rm -rf ../root/config ../root/home ../sync ../sync-main
+
+  process_suite "$DID_SUITE_PASS"
+
+  echo ""
+}
+
+# Test suite asserting how many calls stuff makes
+# for each entry using the preloaded counting shim
+suite_stuff_budget() {
+  SUITES+=1
+  echo "  stuff call budgets"
+
+  command="stuff list --root ../root"
+  output_budget_list=$(assert_budget "$command" "stat=2" "realpath=1+2" "malloc=4+4")
+  title="should probe each side once for each listed entry"
+  make_title "$output_budget_list" "$title"
+  process_result "$output_budget_list"
+
+  ln --symbolic "${PWD}/folder" ../root/folder
+  command="stuff list --root ../root --linked --side root"
+  output_budget_root=$(assert_budget "$command" "stat=1" "lstat=1" "realpath=1+2" "malloc=2+4")
+  title="should probe at most once for each linked entry on the root side"
+  make_title "$output_budget_root" "$title"
+  process_result "$output_budget_root"
+  rm -rf ../root/folder
+
+  command="stuff link --root ../root ./.one"
+  output_budget_link=$(assert_budget "$command" "stat=1" "realpath=2+2" "open=0")
+  title="should probe the project file once when linking"
+  make_title "$output_budget_link" "$title"
+  process_result "$output_budget_link"
+  rm ../root/.one
+
+  command="stuff link --root ../root --layer ../overlay --parents ./folder"
+  output_budget_parents=$(assert_budget "$command" "mkdir=0+1" "symlink=1+1")
+  title="should create shared parents once when linking"
+  make_title "$output_budget_parents" "$title"
+  process_result "$output_budget_parents"
+  rm -rf ../root/folder
+
   process_suite "$DID_SUITE_PASS"
 
   echo ""
@@ -248,6 +690,8 @@ run() {
   suite_stuff_link
   suite_stuff_list
   suite_stuff_unlink
+  suite_stuff_sync
+  suite_stuff_budget
   bold "Test suites: ${SUITES_PASSED} passed" && echo ", ${SUITES} total"
   bold "Tests:       ${TESTS_PASSED} passed" && echo ", ${TESTS} total"
   end_time=$EPOCHREALTIME